@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#include "arena.h"
+
+struct arena_block {
+    arena_block* next;
+    size_t size;
+    max_align_t data[];
+};
+
+#define ALIGNMENT sizeof(max_align_t)
+
+void arena_init(arena* a) { memset(a, 0, sizeof(arena)); }
+
+/* allocations larger than a block get a block of their own */
+static arena_block* add_block(arena* a, size_t size) {
+    arena_block* block;
+
+    if (size < ARENA_BLOCK_SIZE) {
+        size = ARENA_BLOCK_SIZE;
+    }
+
+    block = (arena_block*)malloc(sizeof(arena_block) + size);
+    if (block == NULL) {
+        return NULL;
+    }
+
+    block->size = size;
+    block->next = a->blocks;
+    a->blocks = block;
+    a->used = 0;
+    return block;
+}
+
+void* arena_alloc(arena* a, size_t size) {
+    arena_block* block = a->blocks;
+    void* ptr;
+
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if (size == 0) {
+        size = ALIGNMENT;
+    }
+
+    if (block == NULL || block->size - a->used < size) {
+        if ((block = add_block(a, size)) == NULL) {
+            return NULL;
+        }
+    }
+
+    ptr = (char*)block->data + a->used;
+    a->used = a->used + size;
+    return ptr;
+}
+
+void* arena_calloc(arena* a, size_t count, size_t size) {
+    void* ptr;
+
+    if (size != 0 && count > (size_t)-1 / size) {
+        return NULL;
+    }
+
+    ptr = arena_alloc(a, count * size);
+    if (ptr != NULL) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+char* arena_strdup(arena* a, const char* s) {
+    size_t length = strlen(s) + 1;
+    char* copy = (char*)arena_alloc(a, length);
+
+    if (copy != NULL) {
+        memcpy(copy, s, length);
+    }
+    return copy;
+}
+
+/* keeps the oldest block, which is of the default size unless the
+ * first allocation was a large one */
+void arena_reset(arena* a) {
+    arena_block* block = a->blocks;
+
+    if (block == NULL) {
+        return;
+    }
+
+    while (block->next != NULL) {
+        arena_block* next = block->next;
+        free(block);
+        block = next;
+    }
+
+    a->blocks = block;
+    a->used = 0;
+}
+
+void arena_destroy(arena* a) {
+    arena_block* block = a->blocks;
+
+    while (block != NULL) {
+        arena_block* next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena_init(a);
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#ifndef ARENA_H_ /* Include guard */
+#define ARENA_H_
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+/* size of the blocks an arena allocates from */
+#define ARENA_BLOCK_SIZE 16384
+
+/*
+ * A region allocator for temporaries that all die at the same time,
+ * like the buffers of one diff or the author names of one interval.
+ * Allocating is a pointer bump, and arena_reset() releases everything
+ * at once while keeping the first block for reuse, so a steady state
+ * loop does not call malloc() at all. An arena must only be used by one
+ * thread at a time: every worker has its own.
+ */
+typedef struct arena_block arena_block;
+
+typedef struct {
+    arena_block* blocks;
+    size_t used;
+} arena;
+
+void arena_init(arena* a);
+
+void* arena_alloc(arena* a, size_t size);
+
+void* arena_calloc(arena* a, size_t count, size_t size);
+
+char* arena_strdup(arena* a, const char* s);
+
+void arena_reset(arena* a);
+
+void arena_destroy(arena* a);
+
+#endif
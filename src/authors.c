@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#include "authors.h"
+
+static authorslot* find_slot(authorslot* slots, size_t num_slots,
+    const authorchurn* authors, uint64_t hash, const char* name) {
+    size_t i = hash & (num_slots - 1);
+
+    while (slots[i].index >= 0
+        && (slots[i].hash != hash
+               || strcmp(authors[slots[i].index].name, name) != 0)) {
+        i = (i + 1) & (num_slots - 1);
+    }
+
+    return &slots[i];
+}
+
+static int grow(authormap* map) {
+    size_t num_slots = map->num_slots == 0 ? 64 : 2 * map->num_slots;
+    authorslot* slots = malloc(num_slots * sizeof(authorslot));
+    size_t i;
+
+    if (slots == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < num_slots; i++) {
+        slots[i].index = -1;
+    }
+    for (i = 0; i < map->num_slots; i++) {
+        if (map->slots[i].index >= 0) {
+            authorchurn* a = &map->authors[map->slots[i].index];
+            *find_slot(slots, num_slots, map->authors, map->slots[i].hash,
+                a->name)
+                = map->slots[i];
+        }
+    }
+
+    free(map->slots);
+    map->slots = slots;
+    map->num_slots = num_slots;
+    return 0;
+}
+
+void authormap_init(authormap* map) {
+    memset(map, 0, sizeof(authormap));
+    arena_init(&map->names);
+}
+
+/* returns the index of the author, who is added if necessary */
+int authormap_add(authormap* map, const char* name) {
+    uint64_t hash = hash_string(name, strlen(name));
+    authorslot* slot;
+
+    /* keep the load factor below 3/4 */
+    if (4 * (map->size + 1) > 3 * map->num_slots && grow(map) < 0) {
+        return -1;
+    }
+
+    slot = find_slot(map->slots, map->num_slots, map->authors, hash, name);
+    if (slot->index >= 0) {
+        return slot->index;
+    }
+
+    if (map->size == map->capacity) {
+        size_t capacity = map->capacity == 0 ? 16 : 2 * map->capacity;
+        authorchurn* authors
+            = realloc(map->authors, capacity * sizeof(authorchurn));
+        if (authors == NULL) {
+            return -1;
+        }
+        map->authors = authors;
+        map->capacity = capacity;
+    }
+
+    memset(&map->authors[map->size], 0, sizeof(authorchurn));
+    if ((map->authors[map->size].name = arena_strdup(&map->names, name))
+        == NULL) {
+        return -1;
+    }
+    slot->hash = hash;
+    slot->index = (int)map->size;
+    map->size = map->size + 1;
+    return slot->index;
+}
+
+static int compare_churn(const void* a, const void* b) {
+    const authorchurn* x = (const authorchurn*)a;
+    const authorchurn* y = (const authorchurn*)b;
+
+    if (x->diff.changes != y->diff.changes) {
+        return x->diff.changes > y->diff.changes ? -1 : 1;
+    }
+    return strcmp(x->name, y->name);
+}
+
+/* orders the authors by changed lines, this invalidates the indices,
+ * so no authors can be added afterwards */
+void authormap_sort(authormap* map) {
+    if (map->size > 1) {
+        qsort(map->authors, map->size, sizeof(authorchurn), compare_churn);
+    }
+    free(map->slots);
+    map->slots = NULL;
+    map->num_slots = 0;
+}
+
+void authormap_destroy(authormap* map) {
+    free(map->authors);
+    free(map->slots);
+    arena_destroy(&map->names);
+    memset(map, 0, sizeof(authormap));
+}
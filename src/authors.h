@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#ifndef AUTHORS_H_ /* Include guard */
+#define AUTHORS_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "utils.h"
+#include "arena.h"
+
+/* churn of one author in an interval, the author of a commit is
+ * credited with its diffs against its parents (or predecessor) */
+typedef struct {
+    const char* name;
+    int num_commits;
+    diffresult diff;
+} authorchurn;
+
+typedef struct {
+    uint64_t hash;
+    int index; /* into authors, -1 if the slot is free */
+} authorslot;
+
+/*
+ * The authors of an interval, in the order they were added. Names are
+ * hashed into an open addressing table, so adding is cheap even with
+ * tens of thousands of authors, and the names are copied into an arena
+ * that is released with the map.
+ */
+typedef struct {
+    authorchurn* authors;
+    size_t size;
+    size_t capacity;
+    authorslot* slots;
+    size_t num_slots;
+    arena names;
+} authormap;
+
+void authormap_init(authormap* map);
+
+int authormap_add(authormap* map, const char* name);
+
+void authormap_sort(authormap* map);
+
+void authormap_destroy(authormap* map);
+
+#endif
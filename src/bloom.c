@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#include "bloom.h"
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t num_filters;
+} bloom_header;
+
+typedef struct {
+    git_oid cur;
+    git_oid prev;
+    uint32_t size;
+    uint32_t reserved;
+} bloom_record;
+
+/* largest filter that bloom_build() creates */
+#define MAX_FILTER_SIZE ((BLOOM_MAX_ENTRIES * BLOOM_BITS_PER_ENTRY + 63) / 8)
+
+/* everything from the last dot of the file name, or NULL */
+static const char* path_extension(const char* path) {
+    const char* dot = strrchr(path, '.');
+    const char* slash = strrchr(path, '/');
+    return dot == NULL || (slash != NULL && dot < slash) ? NULL : dot;
+}
+
+/* an extension without another dot or a slash matches exactly the paths
+ * with that extension, so only those can be looked up */
+bool bloom_filterable(const char* extension) {
+    return extension[0] == '.' && strchr(extension + 1, '.') == NULL
+        && strchr(extension, '/') == NULL;
+}
+
+/* double hashing, the bit positions are h1 + i * h2 */
+static void positions(uint64_t* out, const char* s, uint32_t size) {
+    uint64_t h = hash_string(s, strlen(s));
+    uint64_t h1 = h & 0xffffffffULL;
+    uint64_t h2 = (h >> 32) | 1;
+    uint64_t num_bits = (uint64_t)size * 8;
+    int i;
+
+    for (i = 0; i < BLOOM_HASHES; i++) {
+        out[i] = (h1 + (uint64_t)i * h2) % num_bits;
+    }
+}
+
+int bloom_build(bloom_filter* out, arena* a, git_diff* diff) {
+    const char* extensions[BLOOM_MAX_ENTRIES];
+    size_t num_extensions = 0;
+    size_t num_deltas = git_diff_num_deltas(diff);
+    uint64_t bits[BLOOM_HASHES];
+    size_t i;
+    size_t j;
+    int k;
+
+    memset(out, 0, sizeof(bloom_filter));
+
+    for (i = 0; i < num_deltas; i++) {
+        const git_diff_delta* delta = git_diff_get_delta(diff, i);
+        const char* paths[2] = { delta->old_file.path, delta->new_file.path };
+
+        for (k = 0; k < 2; k++) {
+            const char* extension
+                = paths[k] == NULL ? NULL : path_extension(paths[k]);
+            if (extension == NULL) {
+                continue;
+            }
+            for (j = 0; j < num_extensions; j++) {
+                if (!strcmp(extensions[j], extension)) {
+                    break;
+                }
+            }
+            if (j < num_extensions) {
+                continue;
+            }
+            if (num_extensions == BLOOM_MAX_ENTRIES) {
+                /* too many to be useful, matches everything */
+                return 0;
+            }
+            extensions[num_extensions] = extension;
+            num_extensions = num_extensions + 1;
+        }
+    }
+
+    /* whole words of at least 64 bits, an empty filter matches nothing */
+    out->size = (num_extensions * BLOOM_BITS_PER_ENTRY + 63) / 64 * 8;
+    if (out->size == 0) {
+        out->size = 8;
+    }
+    if ((out->bits = (uint8_t*)arena_calloc(a, out->size, 1)) == NULL) {
+        return -1;
+    }
+
+    for (j = 0; j < num_extensions; j++) {
+        positions(bits, extensions[j], out->size);
+        for (k = 0; k < BLOOM_HASHES; k++) {
+            out->bits[bits[k] / 8] |= (uint8_t)(1 << (bits[k] % 8));
+        }
+    }
+
+    return 0;
+}
+
+/* false if no changed path has the extension, true if one might have */
+bool bloom_contains(const bloom_filter* filter, const char* extension) {
+    uint64_t bits[BLOOM_HASHES];
+    int i;
+
+    if (filter->size == 0) {
+        return true;
+    }
+
+    positions(bits, extension, filter->size);
+    for (i = 0; i < BLOOM_HASHES; i++) {
+        if ((filter->bits[bits[i] / 8] & (1 << (bits[i] % 8))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bloom_index* bloom_index_create(void) {
+    bloom_index* index = (bloom_index*)calloc(1, sizeof(bloom_index));
+
+    if (index == NULL) {
+        return NULL;
+    }
+
+    if ((index->filters = oidmap_create()) == NULL) {
+        free(index);
+        return NULL;
+    }
+    arena_init(&index->data);
+    return index;
+}
+
+const bloom_filter* bloom_index_get(
+    bloom_index* index, const git_oid* prev, const git_oid* cur) {
+    void* value;
+    bloom_filter* filter;
+
+    if (!oidmap_get(index->filters, cur, &value)) {
+        return NULL;
+    }
+
+    for (filter = (bloom_filter*)value; filter != NULL;
+         filter = filter->next) {
+        if (git_oid_equal(&filter->prev, prev)) {
+            return filter;
+        }
+    }
+    return NULL;
+}
+
+/* copies the filter into the index */
+static bloom_filter* insert(bloom_index* index, const git_oid* cur,
+    const git_oid* prev, uint32_t size) {
+    bloom_filter* filter
+        = (bloom_filter*)arena_alloc(&index->data, sizeof(bloom_filter));
+    void* value;
+
+    if (filter == NULL) {
+        return NULL;
+    }
+
+    filter->prev = *prev;
+    filter->size = size;
+    filter->bits = NULL;
+    filter->next = oidmap_get(index->filters, cur, &value)
+        ? (bloom_filter*)value
+        : NULL;
+
+    if (size > 0
+        && (filter->bits = (uint8_t*)arena_alloc(&index->data, size))
+            == NULL) {
+        return NULL;
+    }
+    if (oidmap_set(index->filters, cur, filter) < 0) {
+        return NULL;
+    }
+
+    index->size = index->size + 1;
+    return filter;
+}
+
+int bloom_index_add(bloom_index* index, const git_oid* cur,
+    const bloom_filter* filter) {
+    bloom_filter* copy;
+
+    if (bloom_index_get(index, &filter->prev, cur) != NULL) {
+        return 0;
+    }
+
+    if ((copy = insert(index, cur, &filter->prev, filter->size)) == NULL) {
+        return -1;
+    }
+
+    if (filter->size > 0) {
+        memcpy(copy->bits, filter->bits, filter->size);
+    }
+    index->dirty = true;
+    return 0;
+}
+
+/* a missing or outdated file is not an error, it is just rebuilt */
+int bloom_index_read(bloom_index* index, const char* path) {
+    bloom_header header;
+    bloom_record record;
+    bloom_filter* filter;
+    FILE* fp;
+    uint64_t i;
+    int error = 0;
+
+    if ((fp = fopen(path, "rb")) == NULL) {
+        return 0;
+    }
+
+    if (fread(&header, sizeof(header), 1, fp) != 1
+        || memcmp(header.magic, BLOOM_MAGIC, sizeof(BLOOM_MAGIC))
+        || header.version != BLOOM_VERSION) {
+        fclose(fp);
+        return 0;
+    }
+
+    for (i = 0; i < header.num_filters && error == 0; i++) {
+        if (fread(&record, sizeof(record), 1, fp) != 1
+            || record.size > MAX_FILTER_SIZE) {
+            break;
+        }
+        if ((filter = insert(index, &record.cur, &record.prev, record.size))
+            == NULL) {
+            error = -1;
+        } else if (record.size > 0
+            && fread(filter->bits, record.size, 1, fp) != 1) {
+            /* a truncated record matches everything */
+            filter->size = 0;
+            break;
+        }
+    }
+
+    fclose(fp);
+    return error;
+}
+
+/* writes to a temporary file first, so that a concurrent run never
+ * reads a partial file */
+int bloom_index_write(bloom_index* index, const char* path) {
+    char tmp[strlen(path) + 5];
+    bloom_header header;
+    bloom_record record;
+    bloom_filter* filter;
+    size_t iter = 0;
+    git_oid cur;
+    void* value;
+    FILE* fp;
+    int error = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BLOOM_MAGIC, sizeof(BLOOM_MAGIC));
+    header.version = BLOOM_VERSION;
+    header.num_filters = index->size;
+
+    strcpy(tmp, path);
+    strcat(tmp, ".tmp");
+
+    if ((fp = fopen(tmp, "wb")) == NULL) {
+        return -1;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        error = -1;
+    }
+
+    while (error == 0 && oidmap_next(index->filters, &iter, &cur, &value)) {
+        for (filter = (bloom_filter*)value; filter != NULL && error == 0;
+             filter = filter->next) {
+            memset(&record, 0, sizeof(record));
+            record.cur = cur;
+            record.prev = filter->prev;
+            record.size = filter->size;
+            if (fwrite(&record, sizeof(record), 1, fp) != 1
+                || (filter->size > 0
+                       && fwrite(filter->bits, filter->size, 1, fp) != 1)) {
+                error = -1;
+            }
+        }
+    }
+
+    if (fflush(fp) != 0) {
+        error = -1;
+    }
+    if (fclose(fp) != 0 || error < 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+
+    index->dirty = false;
+    return 0;
+}
+
+void bloom_index_destroy(bloom_index* index) {
+    oidmap_destroy(index->filters);
+    arena_destroy(&index->data);
+    free(index);
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#ifndef BLOOM_H_ /* Include guard */
+#define BLOOM_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <git2.h>
+#include "utils.h"
+#include "arena.h"
+#include "oidmap.h"
+
+/*
+ * Changed-path filters, similar to the ones of git's commit-graph.
+ *
+ * For every diffed commit pair, a small Bloom filter holds the file
+ * extensions of the changed paths. When churny is restricted to one
+ * extension, a pair whose filter does not contain it cannot change a
+ * matching file, so the trees do not even have to be loaded. Pairs that
+ * change files with more than BLOOM_MAX_ENTRIES different extensions
+ * get an empty filter that matches everything.
+ *
+ * The filters are kept in a sidecar file in the git directory, so they
+ * are built once and used by all later runs.
+ */
+#define BLOOM_BITS_PER_ENTRY 10
+#define BLOOM_HASHES 7
+#define BLOOM_MAX_ENTRIES 64
+#define BLOOM_FILE "churny-changed-paths"
+#define BLOOM_MAGIC "CHURNYB"
+#define BLOOM_VERSION 1
+
+typedef struct bloom_filter {
+    git_oid prev;
+    uint32_t size; /* in bytes, 0 matches everything */
+    uint8_t* bits;
+    struct bloom_filter* next; /* same commit, other predecessor */
+} bloom_filter;
+
+typedef struct {
+    oidmap* filters; /* commit id -> bloom_filter */
+    arena data;      /* the filters and their bits */
+    size_t size;
+    bool dirty;
+} bloom_index;
+
+bool bloom_filterable(const char* extension);
+
+int bloom_build(bloom_filter* out, arena* a, git_diff* diff);
+
+bool bloom_contains(const bloom_filter* filter, const char* extension);
+
+bloom_index* bloom_index_create(void);
+
+const bloom_filter* bloom_index_get(
+    bloom_index* index, const git_oid* prev, const git_oid* cur);
+
+int bloom_index_add(bloom_index* index, const git_oid* cur,
+    const bloom_filter* filter);
+
+int bloom_index_read(bloom_index* index, const char* path);
+
+int bloom_index_write(bloom_index* index, const char* path);
+
+void bloom_index_destroy(bloom_index* index);
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#include "checkpoint.h"
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t row_size;
+    checkpoint_key key;
+    git_oid boundary;
+    int32_t year;
+    int32_t month;
+    uint64_t num_rows;
+} checkpoint_header;
+
+void checkpoint_init(checkpoint* cp) {
+    /* the key is compared and written as a whole, including padding */
+    memset(cp, 0, sizeof(checkpoint));
+}
+
+int checkpoint_add_row(checkpoint* cp, const churnrow* row) {
+    if (cp->num_rows == cp->capacity) {
+        size_t capacity = cp->capacity == 0 ? 64 : 2 * cp->capacity;
+        churnrow* rows = realloc(cp->rows, capacity * sizeof(churnrow));
+        if (rows == NULL) {
+            return -1;
+        }
+        cp->rows = rows;
+        cp->capacity = capacity;
+    }
+
+    cp->rows[cp->num_rows] = *row;
+    /* the churn of the authors does not outlive the callback */
+    cp->rows[cp->num_rows].author_churn = NULL;
+    cp->rows[cp->num_rows].coupling = NULL;
+    cp->num_rows = cp->num_rows + 1;
+    return 0;
+}
+
+/* writes to a temporary file first, so that a crash while writing
+ * leaves the previous checkpoint intact */
+int checkpoint_write(const checkpoint* cp, const char* path) {
+    char tmp[strlen(path) + 5];
+    checkpoint_header header;
+    FILE* fp;
+    int error = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    header.version = CHECKPOINT_VERSION;
+    header.row_size = sizeof(churnrow);
+    header.key = cp->key;
+    header.boundary = cp->boundary;
+    header.year = cp->year;
+    header.month = cp->month;
+    header.num_rows = cp->num_rows;
+
+    strcpy(tmp, path);
+    strcat(tmp, ".tmp");
+
+    if ((fp = fopen(tmp, "wb")) == NULL) {
+        return -1;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1
+        || (cp->num_rows > 0
+               && fwrite(cp->rows, sizeof(churnrow), cp->num_rows, fp)
+                   != cp->num_rows)
+        || fflush(fp) != 0 || fsync(fileno(fp)) != 0) {
+        error = -1;
+    }
+
+    if (fclose(fp) != 0 || error < 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+
+    return 0;
+}
+
+int checkpoint_read(checkpoint* cp, const char* path) {
+    checkpoint_header header;
+    FILE* fp;
+    size_t i;
+
+    if ((fp = fopen(path, "rb")) == NULL) {
+        return -1;
+    }
+
+    if (fread(&header, sizeof(header), 1, fp) != 1
+        || memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC))
+        || header.version != CHECKPOINT_VERSION
+        || header.row_size != sizeof(churnrow)) {
+        fclose(fp);
+        return -1;
+    }
+
+    cp->key = header.key;
+    cp->boundary = header.boundary;
+    cp->year = header.year;
+    cp->month = header.month;
+    cp->num_rows = 0;
+
+    for (i = 0; i < header.num_rows; i++) {
+        churnrow row;
+        if (fread(&row, sizeof(churnrow), 1, fp) != 1
+            || checkpoint_add_row(cp, &row) < 0) {
+            fclose(fp);
+            return -1;
+        }
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+void checkpoint_free(checkpoint* cp) {
+    free(cp->rows);
+    cp->rows = NULL;
+    cp->num_rows = 0;
+    cp->capacity = 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#ifndef CHECKPOINT_H_ /* Include guard */
+#define CHECKPOINT_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <git2.h>
+#include "output.h"
+
+#define CHECKPOINT_MAGIC "CHURNYK"
+#define CHECKPOINT_VERSION 5
+
+/* default number of seconds between two checkpoints */
+#define CHECKPOINT_SECONDS 60
+
+/* a checkpoint can only be resumed by a run with the same settings */
+typedef struct {
+    git_oid head;
+    int interval;
+    int diff_mode;
+    int renames;
+    uint64_t rename_limit;
+    int author_sketches;
+    int languages;
+    char extension[256];
+} checkpoint_key;
+
+/*
+ * State of an interval analysis after the last reported interval.
+ * The rows are replayed on resume, so that the output is the same as
+ * that of an uninterrupted run. The walk continues at boundary, the
+ * first commit of the next interval, which begins in year and month
+ * (as in struct tm). All other state starts empty at an interval
+ * boundary.
+ *
+ * The file is written in host byte order by the same build, it stores
+ * the rows as they are in memory.
+ */
+typedef struct {
+    checkpoint_key key;
+    git_oid boundary;
+    int year;
+    int month;
+    churnrow* rows;
+    size_t num_rows;
+    size_t capacity;
+} checkpoint;
+
+void checkpoint_init(checkpoint* cp);
+
+int checkpoint_add_row(checkpoint* cp, const churnrow* row);
+
+int checkpoint_write(const checkpoint* cp, const char* path);
+
+int checkpoint_read(checkpoint* cp, const char* path);
+
+void checkpoint_free(checkpoint* cp);
+
+#endif
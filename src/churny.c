@@ -30,24 +30,861 @@
  */
 
 #include "churny.h"
+#include "pipeline.h"
+
+int set_error(churny_ctx* ctx, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    pthread_mutex_lock(&ctx->lock);
+    vsnprintf(ctx->error, sizeof(ctx->error), format, args);
+    pthread_mutex_unlock(&ctx->lock);
+    va_end(args);
+    return -1;
+}
+
+int set_git_error(churny_ctx* ctx, const char* id) {
+    const git_error* e = git_error_last();
+    return set_error(ctx, "%s %s - %s", fatal, id,
+        e != NULL && e->message != NULL ? e->message : "libgit2 error");
+}
+
+static int store_row(const churnrow* row, void* payload) {
+    *(churnrow*)payload = *row;
+    ((churnrow*)payload)->author_churn = NULL;
+    ((churnrow*)payload)->coupling = NULL;
+    return 0;
+}
+
+typedef struct {
+    churnrow* rows;
+    size_t size;
+    size_t capacity;
+} rowarray;
+
+static int append_row(const churnrow* row, void* payload) {
+    rowarray* array = (rowarray*)payload;
+
+    if (array->size == array->capacity) {
+        size_t capacity = array->capacity == 0 ? 64 : 2 * array->capacity;
+        churnrow* rows = realloc(array->rows, capacity * sizeof(churnrow));
+        if (rows == NULL) {
+            return -1;
+        }
+        array->rows = rows;
+        array->capacity = capacity;
+    }
+
+    array->rows[array->size] = *row;
+    array->rows[array->size].author_churn = NULL;
+    array->rows[array->size].coupling = NULL;
+    array->size = array->size + 1;
+    return 0;
+}
+
+static int cache_compare(void const* item1, void const* item2) {
+    return strcmp((char const*)item1, ((churny_cache const*)item2)->extension);
+}
+
+/* must be called with ctx->lock held */
+static churny_cache* get_cache(churny_ctx* ctx, const char* extension) {
+    Node* ptr = ctx->caches->first;
+    churny_cache* cache;
+
+    while (ptr != NULL) {
+        if (cache_compare(extension, ptr->value) == 0) {
+            return (churny_cache*)ptr->value;
+        }
+        ptr = ptr->next;
+    }
+
+    cache = (churny_cache*)malloc(sizeof(churny_cache));
+    if (cache == NULL) {
+        return NULL;
+    }
+    cache->extension = strdup(extension);
+    cache->loc = oidmap_create();
+    cache->diffs = oidmap_create();
+    cache->languages = oidmap_create();
+    arena_init(&cache->entries);
+    list_add(ctx->caches, cache);
+    return cache;
+}
+
+static void free_caches(List* caches) {
+    Node* ptr = caches->first;
+
+    while (ptr != NULL) {
+        churny_cache* cache = (churny_cache*)ptr->value;
+        oidmap_destroy(cache->diffs);
+        oidmap_destroy(cache->languages);
+        arena_destroy(&cache->entries);
+        oidmap_destroy(cache->loc);
+        free(cache->extension);
+        free(cache);
+        ptr = ptr->next;
+    }
+
+    list_destroy(caches);
+}
+
+int churny_open(churny_ctx** out, const char* path) {
+    char resolved[PATH_MAX];
+    churny_ctx* ctx;
+
+    *out = NULL;
+
+    /* workers open the repository again, possibly from another
+     * working directory */
+    if (realpath(path, resolved) == NULL) {
+        return -1;
+    }
+
+    git_libgit2_init();
+
+    ctx = (churny_ctx*)calloc(1, sizeof(churny_ctx));
+    if (ctx == NULL) {
+        git_libgit2_shutdown();
+        return -1;
+    }
+
+    if (git_repository_open(&ctx->repo, resolved) < 0) {
+        free(ctx);
+        git_libgit2_shutdown();
+        return -1;
+    }
+
+    ctx->path = strdup(resolved);
+    ctx->caches = list_create();
+    ctx->renames.limit = RENAME_LIMIT;
+    ctx->num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ctx->num_threads < 1) {
+        ctx->num_threads = 1;
+    }
+    pthread_mutex_init(&ctx->lock, NULL);
+    *out = ctx;
+    return 0;
+}
+
+void churny_free(churny_ctx* ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+
+    churny_set_threads(ctx, 0);
+    churny_set_changed_paths(ctx, false);
+    churny_set_graph_cache(ctx, false);
+    pthread_mutex_destroy(&ctx->lock);
+    free_caches(ctx->caches);
+    if (ctx->blob_lines != NULL) {
+        oidmap_destroy(ctx->blob_lines);
+    }
+    free(ctx->checkpoint_path);
+    free(ctx->status_path);
+    free(ctx->path);
+    git_repository_free(ctx->repo);
+    free(ctx);
+    git_libgit2_shutdown();
+}
+
+const char* churny_error(const churny_ctx* ctx) { return ctx->error; }
+
+void churny_set_threads(churny_ctx* ctx, int num_threads) {
+    if (ctx->pool != NULL) {
+        pool_destroy(ctx->pool);
+        ctx->pool = NULL;
+    }
+    if (ctx->blob_pool != NULL) {
+        pool_destroy(ctx->blob_pool);
+        ctx->blob_pool = NULL;
+    }
+    ctx->num_threads = num_threads;
+}
+
+/* a budget > 0 switches to approximate results, see pipeline.h */
+void churny_set_sampling(churny_ctx* ctx, int budget) {
+    ctx->sample_budget = budget > 0 ? budget : 0;
+}
 
-static void usage(const char* basename) {
-    printf("Usage: %s [option]... [file]\n", basename);
-    printf("  h\tPrints this message\n");
-    printf("  c\tOnly count lines of code\n");
-    printf("  m calculate churn separately for each month\n");
-    printf("  y calculate churn separately for each year\n");
-    printf("\n");
+void churny_set_diff_mode(churny_ctx* ctx, diffmode mode) {
+    ctx->diff_mode = mode;
 }
 
-static void print_csv_header() {
-    printf("%s\n", "Base Date;Last Date;Base Id; Last Id;Commits;"
-                   "Authors;Base LoC;Last LoC;Ratio;Added LoC;"
-                   "Removed LoC;Changed LoC;Relative Code Churn");
+/* limit caps the number of file pairs scored for similarity per diff */
+void churny_set_renames(churny_ctx* ctx, renamemode mode, size_t limit) {
+    ctx->renames.mode = mode;
+    ctx->renames.limit = limit;
 }
 
-diffresult calculate_diff(git_repository* repo, const git_oid* prev,
+/* the filters are stored in the git directory,
+ * new ones are saved when they are disabled again */
+int churny_set_changed_paths(churny_ctx* ctx, bool enabled) {
+    const char* gitdir = git_repository_path(ctx->repo);
+    char path[strlen(gitdir) + sizeof(BLOOM_FILE)];
+    int error = 0;
+
+    strcpy(path, gitdir);
+    strcat(path, BLOOM_FILE);
+
+    if (enabled && ctx->bloom == NULL) {
+        if ((ctx->bloom = bloom_index_create()) == NULL) {
+            return -1;
+        }
+        error = bloom_index_read(ctx->bloom, path);
+    } else if (!enabled && ctx->bloom != NULL) {
+        if (ctx->bloom->dirty) {
+            error = bloom_index_write(ctx->bloom, path);
+        }
+        bloom_index_destroy(ctx->bloom);
+        ctx->bloom = NULL;
+    }
+
+    return error;
+}
+
+/* the graph is read again on first use, new commits are saved to the
+ * cache when it is disabled again */
+int churny_set_graph_cache(churny_ctx* ctx, bool enabled) {
+    int error = 0;
+
+    if (ctx->graph != NULL) {
+        error = graph_save(ctx->graph);
+        graph_destroy(ctx->graph);
+        ctx->graph = NULL;
+    }
+    ctx->graph_cache = enabled;
+    return error;
+}
+
+graph* churny_graph(churny_ctx* ctx) {
+    if (ctx->graph == NULL) {
+        ctx->graph = graph_open(ctx->repo, ctx->graph_cache);
+    }
+    return ctx->graph;
+}
+
+/* adds a mergeable sketch of the authors to each row */
+void churny_set_author_sketches(churny_ctx* ctx, bool enabled) {
+    ctx->author_sketches = enabled;
+}
+
+/* passes the churn of each author to the row callback */
+void churny_set_author_churn(churny_ctx* ctx, bool enabled) {
+    ctx->author_churn = enabled;
+}
+
+/* reports a row per language and interval, the extension is ignored */
+void churny_set_languages(churny_ctx* ctx, bool enabled) {
+    ctx->languages = enabled;
+}
+
+/* passes the pairs of files and directories changed together most often
+ * to the row callback, not with sampling or languages */
+void churny_set_coupling(churny_ctx* ctx, bool enabled) {
+    ctx->coupling = enabled;
+}
+
+/* counts the lines added in each interval that survive until HEAD,
+ * not with sampling, checkpoints or diffs against all parents */
+void churny_set_survival(churny_ctx* ctx, bool enabled) {
+    ctx->survival = enabled;
+}
+
+/*
+ * Interval analyses write their state to path every few seconds, and
+ * continue from there if resume is set and the file exists. A NULL path
+ * turns checkpoints off.
+ */
+int churny_set_checkpoint(
+    churny_ctx* ctx, const char* path, int seconds, bool resume) {
+    free(ctx->checkpoint_path);
+    ctx->checkpoint_path = NULL;
+    if (path != NULL && (ctx->checkpoint_path = strdup(path)) == NULL) {
+        return -1;
+    }
+    ctx->checkpoint_seconds = seconds;
+    ctx->resume = resume;
+    return 0;
+}
+
+/*
+ * Analyses that are still running at the deadline stop walking and
+ * report what they have, the first interval that is not complete as a
+ * partial row. ctx->expired tells whether that happened.
+ */
+void churny_set_deadline(churny_ctx* ctx, time_t deadline) {
+    ctx->deadline = deadline;
+}
+
+/* analyses print a line to stream and/or replace the status file at
+ * path every few seconds, both may be NULL */
+int churny_set_progress(
+    churny_ctx* ctx, FILE* stream, const char* path, int seconds) {
+    free(ctx->status_path);
+    ctx->status_path = NULL;
+    if (path != NULL && (ctx->status_path = strdup(path)) == NULL) {
+        return -1;
+    }
+    ctx->progress_stream = stream;
+    ctx->progress_seconds = seconds;
+    return 0;
+}
+
+/*
+ * The pools are started on first use and kept for later calls.
+ *
+ * Starting them changes process-wide settings of libgit2, which also
+ * apply to the repositories of the program that embeds churny: the
+ * object cache limit is raised to CACHE_LIMIT, unless it is higher
+ * already, and trees up to CACHE_TREE_LIMIT are kept in the cache.
+ */
+pool* churny_pool(churny_ctx* ctx) {
+    ssize_t used;
+    ssize_t allowed;
+
+    if (ctx->pool == NULL) {
+        if (git_libgit2_opts(GIT_OPT_GET_CACHED_MEMORY, &used, &allowed) < 0
+            || allowed < CACHE_LIMIT) {
+            git_libgit2_opts(
+                GIT_OPT_SET_CACHE_MAX_SIZE, (ssize_t)CACHE_LIMIT);
+        }
+        git_libgit2_opts(GIT_OPT_SET_CACHE_OBJECT_LIMIT, GIT_OBJECT_TREE,
+            (size_t)CACHE_TREE_LIMIT);
+        ctx->pool = pool_create(ctx->path, ctx->num_threads);
+    }
+    return ctx->pool;
+}
+
+int churny_loc(
+    int* out, churny_ctx* ctx, const git_oid* commit, const char* extension) {
+    return calculate_cached_loc(out, ctx, ctx->repo, commit, extension);
+}
+
+int churny_diff(diffresult* out, churny_ctx* ctx, const git_oid* prev,
     const git_oid* cur, const char* extension) {
+    return calculate_cached_diff(out, ctx, ctx->repo, NULL, NULL, prev, cur,
+        NULL, NULL, extension, NULL, NULL);
+}
+
+/* counts the lines of the blobs ids[begin..end) into lines, through a
+ * handle of the object database of repo, which is not shared */
+static int count_blobs(int* lines, git_repository* repo, const git_oid* ids,
+    size_t begin, size_t end) {
+    git_odb* odb;
+    git_odb_object* object;
+    size_t i;
+    int error;
+
+    if ((error = git_repository_odb(&odb, repo)) < 0) {
+        return error;
+    }
+
+    for (i = begin; error == 0 && i < end; i++) {
+        if ((error = git_odb_read(&object, odb, &ids[i])) < 0) {
+            break;
+        }
+        lines[i] = git_odb_object_type(object) != GIT_OBJECT_BLOB
+            ? 0
+            : count_lines(
+                  (const unsigned char*)git_odb_object_data(object),
+                  git_odb_object_size(object));
+        git_odb_object_free(object);
+    }
+
+    git_odb_free(odb);
+    return error;
+}
+
+/* blobs of a tree that are counted by the blob pool */
+typedef struct {
+    const git_oid* ids;
+    int* lines;
+    int pending; /* runs that are not done yet */
+    int error;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+} blobcount;
+
+typedef struct {
+    blobcount* count;
+    size_t begin;
+    size_t end;
+} blobrun;
+
+static void finish_run(blobcount* count, int error) {
+    pthread_mutex_lock(&count->lock);
+    if (error < 0 && count->error == 0) {
+        count->error = error;
+    }
+    count->pending = count->pending - 1;
+    pthread_cond_signal(&count->done);
+    pthread_mutex_unlock(&count->lock);
+}
+
+static void run_blobs(worker* w, void* arg) {
+    blobrun* run = (blobrun*)arg;
+    span s;
+    int error;
+
+    TIMELINE_BEGIN(&s, blobs);
+    error = count_blobs(
+        run->count->lines, w->repo, run->count->ids, run->begin, run->end);
+    TIMELINE_END(&s, blobs);
+
+    finish_run(run->count, error);
+    free(run);
+}
+
+/*
+ * The lines of code are counted by the workers of the pool, which wait
+ * for the blob pool here. So the blob pool is a pool of its own, and its
+ * workers never wait for others.
+ */
+static pool* blob_pool(churny_ctx* ctx) {
+    pthread_mutex_lock(&ctx->lock);
+    if (ctx->blob_pool == NULL) {
+        ctx->blob_pool = pool_create(ctx->path, ctx->num_threads);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return ctx->blob_pool;
+}
+
+/*
+ * Counts the lines of the blobs ids[0..size). A tree that has not been
+ * counted before has tens of thousands of blobs to inflate, so they are
+ * split into runs for the blob pool, each worker reading them with its
+ * own repository.
+ */
+static int count_blob_runs(int* lines, churny_ctx* ctx, git_repository* repo,
+    const git_oid* ids, size_t size) {
+    blobcount count;
+    pool* blobs = NULL;
+    size_t begin;
+    int error = 0;
+
+    if (ctx->num_threads > 1 && size >= 2 * BLOB_BATCH) {
+        blobs = blob_pool(ctx);
+    }
+    if (blobs == NULL) {
+        return count_blobs(lines, repo, ids, 0, size);
+    }
+
+    count.ids = ids;
+    count.lines = lines;
+    count.pending = 0;
+    count.error = 0;
+    pthread_mutex_init(&count.lock, NULL);
+    pthread_cond_init(&count.done, NULL);
+
+    for (begin = 0; begin < size; begin = begin + BLOB_BATCH) {
+        blobrun* run = (blobrun*)malloc(sizeof(blobrun));
+        size_t end = begin + BLOB_BATCH < size ? begin + BLOB_BATCH : size;
+
+        pthread_mutex_lock(&count.lock);
+        count.pending = count.pending + 1;
+        pthread_mutex_unlock(&count.lock);
+
+        if (run != NULL) {
+            run->count = &count;
+            run->begin = begin;
+            run->end = end;
+        }
+        if (run == NULL || pool_submit(blobs, run_blobs, run) < 0) {
+            /* counted in place instead */
+            free(run);
+            finish_run(&count, count_blobs(lines, repo, ids, begin, end));
+        }
+    }
+
+    pthread_mutex_lock(&count.lock);
+    while (count.pending > 0) {
+        pthread_cond_wait(&count.done, &count.lock);
+    }
+    error = count.error;
+    pthread_mutex_unlock(&count.lock);
+
+    pthread_cond_destroy(&count.done);
+    pthread_mutex_destroy(&count.lock);
+    return error;
+}
+
+/*
+ * Adds up the lines of code of the files to out, by their language.
+ * Most files of two boundary commits are the same, so the lines of each
+ * blob are only counted once. The blobs that have not been counted yet
+ * are collected first and counted together, see count_blob_runs().
+ */
+static int count_files(int* out, churny_ctx* ctx, git_repository* repo,
+    const langfiles* list) {
+    git_oid* ids = NULL;
+    size_t* slots = NULL; /* of each file in ids, or SIZE_MAX if counted */
+    int* lines = NULL;
+    oidmap* missing = NULL; /* blob id -> slot + 1 */
+    size_t num_ids = 0;
+    void* value;
+    size_t i;
+    int error = 0;
+
+    pthread_mutex_lock(&ctx->lock);
+    if (ctx->blob_lines == NULL) {
+        ctx->blob_lines = oidmap_create();
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (ctx->blob_lines == NULL || list->size == 0) {
+        return ctx->blob_lines == NULL ? -1 : 0;
+    }
+
+    ids = (git_oid*)malloc(list->size * sizeof(git_oid));
+    slots = (size_t*)malloc(list->size * sizeof(size_t));
+    lines = (int*)malloc(list->size * sizeof(int));
+    missing = oidmap_create();
+    if (ids == NULL || slots == NULL || lines == NULL || missing == NULL) {
+        error = -1;
+        goto cleanup;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    for (i = 0; error == 0 && i < list->size; i++) {
+        langfile* file = &list->files[i];
+
+        slots[i] = SIZE_MAX;
+        if (oidmap_get(ctx->blob_lines, &file->id, &value)) {
+            out[file->language] = out[file->language] + (int)(intptr_t)value;
+        } else if (oidmap_get(missing, &file->id, &value)) {
+            slots[i] = (size_t)(uintptr_t)value - 1;
+        } else {
+            slots[i] = num_ids;
+            ids[num_ids] = file->id;
+            num_ids = num_ids + 1;
+            error = oidmap_set(
+                missing, &file->id, (void*)(uintptr_t)num_ids);
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (error == 0 && num_ids > 0) {
+        error = count_blob_runs(lines, ctx, repo, ids, num_ids);
+    }
+    if (error < 0) {
+        goto cleanup;
+    }
+
+    for (i = 0; i < list->size; i++) {
+        if (slots[i] != SIZE_MAX) {
+            langfile* file = &list->files[i];
+            out[file->language] = out[file->language] + lines[slots[i]];
+        }
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    for (i = 0; error == 0 && i < num_ids; i++) {
+        error = oidmap_set(
+            ctx->blob_lines, &ids[i], (void*)(intptr_t)lines[i]);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+cleanup:
+    if (missing != NULL) {
+        oidmap_destroy(missing);
+    }
+    free(lines);
+    free(slots);
+    free(ids);
+    return error;
+}
+
+/* lines of code are counted in the object database,
+ * so bare repositories can be analyzed as well */
+int calculate_cached_loc(int* out, churny_ctx* ctx, git_repository* repo,
+    const git_oid* commit, const char* extension) {
+    const char id[] = "calculate_cached_loc";
+    langfiles list = { NULL, 0, 0 };
+    churny_cache* cache;
+    void* value;
+    int loc = 0;
+    int error;
+
+    pthread_mutex_lock(&ctx->lock);
+    cache = get_cache(ctx, extension);
+    if (cache != NULL && oidmap_get(cache->loc, commit, &value)) {
+        ctx->stats.loc_hits = ctx->stats.loc_hits + 1;
+        pthread_mutex_unlock(&ctx->lock);
+        *out = (int)(intptr_t)value;
+        return 0;
+    }
+    ctx->stats.loc_misses = ctx->stats.loc_misses + 1;
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (cache == NULL) {
+        return set_error(ctx, "%s %s - Out of memory", fatal, id);
+    }
+
+    if ((error = list_counted_files(&list, repo, commit, extension)) == 0) {
+        error = count_files(&loc, ctx, repo, &list);
+    }
+    free(list.files);
+    if (error < 0) {
+        return set_error(
+            ctx, "%s %s - Error while counting lines of code", fatal, id);
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    oidmap_set(cache->loc, commit, (void*)(intptr_t)loc);
+    pthread_mutex_unlock(&ctx->lock);
+
+    *out = loc;
+    return 0;
+}
+
+/* counts the lines of code of each language of a commit,
+ * out has NUM_LANGUAGES elements */
+int calculate_cached_languages(int* out, churny_ctx* ctx,
+    git_repository* repo, const git_oid* commit) {
+    const char id[] = "calculate_cached_languages";
+    langfiles list = { NULL, 0, 0 };
+    churny_cache* cache;
+    int loc[NUM_LANGUAGES];
+    void* value;
+    int error;
+
+    pthread_mutex_lock(&ctx->lock);
+    cache = get_cache(ctx, "");
+    if (cache != NULL && oidmap_get(cache->languages, commit, &value)) {
+        ctx->stats.loc_hits = ctx->stats.loc_hits + 1;
+        pthread_mutex_unlock(&ctx->lock);
+        memcpy(out, value, sizeof(loc));
+        return 0;
+    }
+    ctx->stats.loc_misses = ctx->stats.loc_misses + 1;
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (cache == NULL) {
+        return set_error(ctx, "%s %s - Out of memory", fatal, id);
+    }
+
+    memset(loc, 0, sizeof(loc));
+    if ((error = list_counted_files(&list, repo, commit, NULL)) == 0) {
+        error = count_files(loc, ctx, repo, &list);
+    }
+    free(list.files);
+    if (error < 0) {
+        return set_error(
+            ctx, "%s %s - Error while counting lines of code", fatal, id);
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    value = arena_alloc(&cache->entries, sizeof(loc));
+    if (value != NULL) {
+        memcpy(value, loc, sizeof(loc));
+        error = oidmap_set(cache->languages, commit, value);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (value == NULL || error < 0) {
+        return set_error(ctx, "%s %s - Out of memory", fatal, id);
+    }
+
+    memcpy(out, loc, sizeof(loc));
+    return 0;
+}
+
+/* prev_tree and cur_tree may be NULL, see calculate_diff(),
+ * languages has NUM_LANGUAGES elements and may be NULL, so may script,
+ * which needs the hunks and is never answered from the cache */
+int calculate_cached_diff(diffresult* out, churny_ctx* ctx,
+    git_repository* repo, treecache* trees, arena* scratch,
+    const git_oid* prev, const git_oid* cur, const git_oid* prev_tree,
+    const git_oid* cur_tree, const char* extension,
+    diffresult* languages, editscript* script) {
+    const char id[] = "calculate_cached_diff";
+    churny_cache* cache;
+    diffentry* entry = NULL;
+    diffresult result;
+    const bloom_filter* filter = NULL;
+    bloom_filter built;
+    span s;
+    bool build = false;
+    bool skip = false;
+    void* value;
+    int error = 0;
+
+    /* a commit is usually diffed against the same predecessor,
+     * unless new history was inserted in between */
+    pthread_mutex_lock(&ctx->lock);
+    cache = get_cache(ctx, extension);
+    if (cache != NULL && script == NULL
+        && oidmap_get(cache->diffs, cur, &value)) {
+        entry = (diffentry*)value;
+        if (git_oid_equal(&entry->prev, prev)
+            && entry->renames.mode == ctx->renames.mode
+            && entry->renames.limit == ctx->renames.limit
+            && (languages == NULL || entry->languages != NULL)) {
+            ctx->stats.diff_hits = ctx->stats.diff_hits + 1;
+            *out = entry->result;
+            if (languages != NULL) {
+                memcpy(languages, entry->languages,
+                    NUM_LANGUAGES * sizeof(diffresult));
+            }
+            pthread_mutex_unlock(&ctx->lock);
+            return 0;
+        }
+    }
+    ctx->stats.diff_misses = ctx->stats.diff_misses + 1;
+
+    /* if no changed path can match, the diff is not needed at all,
+     * filters are built along with the diffs (in a worker's scratch) */
+    if (ctx->bloom != NULL) {
+        filter = bloom_index_get(ctx->bloom, prev, cur);
+        skip = filter != NULL && bloom_filterable(extension)
+            && !bloom_contains(filter, extension);
+        build = filter == NULL && scratch != NULL;
+    }
+    if (skip) {
+        ctx->stats.bloom_skips = ctx->stats.bloom_skips + 1;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (cache == NULL) {
+        return set_error(ctx, "%s %s - Out of memory", fatal, id);
+    }
+
+    if (skip) {
+        memset(&result, 0, sizeof(result));
+        if (languages != NULL) {
+            memset(languages, 0, NUM_LANGUAGES * sizeof(diffresult));
+        }
+    } else {
+        TIMELINE_BEGIN(&s, diff);
+        error = calculate_diff(&result, repo, trees, scratch, prev, cur,
+            prev_tree, cur_tree, extension, &ctx->renames,
+            build ? &built : NULL, languages, script);
+        TIMELINE_END(&s, diff);
+        if (error < 0) {
+            return set_git_error(ctx, id);
+        }
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    if (build) {
+        built.prev = *prev;
+        error = bloom_index_add(ctx->bloom, cur, &built);
+    }
+    if (!oidmap_get(cache->diffs, cur, &value)) {
+        value = arena_alloc(&cache->entries, sizeof(diffentry));
+        if (value == NULL || oidmap_set(cache->diffs, cur, value) < 0) {
+            value = NULL;
+            error = -1;
+        }
+    }
+    if (value != NULL) {
+        entry = (diffentry*)value;
+        entry->prev = *prev;
+        entry->renames = ctx->renames;
+        entry->result = result;
+        entry->languages = NULL;
+        if (languages != NULL) {
+            entry->languages = (diffresult*)arena_alloc(
+                &cache->entries, NUM_LANGUAGES * sizeof(diffresult));
+            if (entry->languages == NULL) {
+                error = -1;
+            } else {
+                memcpy(entry->languages, languages,
+                    NUM_LANGUAGES * sizeof(diffresult));
+            }
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (error < 0) {
+        return set_error(ctx, "%s %s - Out of memory", fatal, id);
+    }
+
+    *out = result;
+    return 0;
+}
+
+void calculate_ratios(churnrow* row) {
+    row->ratio = row->first_loc == 0
+        ? row->last_loc == 0 ? 0.0 : 1.0
+        : (double)row->last_loc / (double)row->first_loc;
+
+    /* compute relative code churn */
+    row->churn = row->last_loc == 0
+        ? 0
+        : (double)row->diff.changes / (double)row->last_loc;
+}
+
+int churny_churn(churnrow* out, churny_ctx* ctx, const git_oid* from,
+    const git_oid* to, const char* extension) {
+    memset(out, 0, sizeof(churnrow));
+    out->language = -1;
+    return calculate_code_churn(NULL, ctx, from, to, extension, store_row, out);
+}
+
+int churny_foreach_interval(churny_ctx* ctx, const interval interval,
+    const char* extension, churny_row_cb cb, void* payload) {
+    return calculate_interval_code_churn(
+        NULL, ctx, interval, extension, cb, payload);
+}
+
+int churny_intervals(churnrow** rows, size_t* num_rows, churny_ctx* ctx,
+    const interval interval, const char* extension) {
+    rowarray array = { NULL, 0, 0 };
+    int error = calculate_interval_code_churn(
+        NULL, ctx, interval, extension, append_row, &array);
+
+    if (error < 0) {
+        free(array.rows);
+        *rows = NULL;
+        *num_rows = 0;
+        return error;
+    }
+
+    *rows = array.rows;
+    *num_rows = array.size;
+    return 0;
+}
+
+void churny_rows_free(churnrow* rows) { free(rows); }
+
+void churny_get_stats(churny_stats* out, churny_ctx* ctx) {
+    pthread_mutex_lock(&ctx->lock);
+    *out = ctx->stats;
+    pthread_mutex_unlock(&ctx->lock);
+
+    /* the graph is only used by the thread that walks */
+    out->commits_parsed = ctx->graph != NULL ? ctx->graph->parsed : 0;
+}
+
+static void print_ratio(FILE* stream, const char* name, unsigned long hits,
+    unsigned long misses) {
+    unsigned long lookups = hits + misses;
+    fprintf(stream, "%s cache: %lu hits, %lu misses, hit ratio %.2f\n", name,
+        hits, misses, lookups == 0 ? 0.0 : (double)hits / (double)lookups);
+}
+
+void churny_print_stats(FILE* stream, const churny_stats* stats) {
+    print_ratio(stream, "diff", stats->diff_hits, stats->diff_misses);
+    print_ratio(stream, "loc", stats->loc_hits, stats->loc_misses);
+    print_ratio(stream, "tree", stats->tree_hits, stats->tree_misses);
+    fprintf(stream, "changed-path filters: %lu diffs skipped\n",
+        stats->bloom_skips);
+    fprintf(stream, "commit graph: %lu commits parsed\n",
+        stats->commits_parsed);
+}
+
+/* prev_id and cur_id are the trees of the commits and may be NULL, then
+ * the commits are parsed to find them,
+ * scratch holds the temporaries and may be NULL, the caller resets it,
+ * if filter is not NULL, it is set to the changed-path filter of the pair,
+ * which is allocated in scratch, if languages is not NULL, it is set to
+ * the changes of each of the NUM_LANGUAGES languages, and if script is
+ * not NULL, the hunks of the matching files are recorded in it */
+int calculate_diff(diffresult* out, git_repository* repo, treecache* trees,
+    arena* scratch, const git_oid* prev, const git_oid* cur,
+    const git_oid* prev_id, const git_oid* cur_id, const char* extension,
+    const renameopts* renames, bloom_filter* filter, diffresult* languages,
+    editscript* script) {
     const char id[] = "calculate_diff";
 
 #if defined(DEBUG) || defined(TRACE)
@@ -59,35 +896,71 @@ diffresult calculate_diff(git_repository* repo, const git_oid* prev,
     cur_buf[GIT_OID_HEXSZ] = '\0';
 #endif
 
-    git_commit* commit;
-    git_tree* prev_tree;
-    git_tree* cur_tree;
-    git_diff* diff;
-    git_time_t prev_time;
-    git_time_t cur_time;
+    git_tree* prev_tree = NULL;
+    git_tree* cur_tree = NULL;
+    git_diff* diff = NULL;
+    git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+    git_diff_stats* stats = NULL;
+    git_buf b = GIT_BUF_INIT_CONST(NULL, 0);
+    arena local;
     struct tm* tm;
+    int error;
+    int i;
     diffresult result;
     result.insertions = 0;
     result.deletions = 0;
     result.changes = 0;
 
-    git_commit_lookup(&commit, repo, prev);
-    prev_time = git_commit_time(commit);
-    git_commit_tree(&prev_tree, commit);
-    git_commit_lookup(&commit, repo, cur);
-    cur_time = git_commit_time(commit);
-    git_commit_tree(&cur_tree, commit);
+    arena_init(&local);
+    if (scratch == NULL) {
+        scratch = &local;
+    }
+    if (languages != NULL) {
+        memset(languages, 0, NUM_LANGUAGES * sizeof(diffresult));
+    }
+
+    if ((error = treecache_lookup(&prev_tree, trees, repo, prev, prev_id)) < 0
+        || (error = treecache_lookup(&cur_tree, trees, repo, cur, cur_id))
+            < 0) {
+        goto cleanup;
+    }
+
+    /* run diff, hunks of edit scripts have no context */
+    if (script != NULL) {
+        opts.context_lines = 0;
+        opts.interhunk_lines = 0;
+    }
+    if ((error = git_diff_tree_to_tree(&diff, repo, prev_tree, cur_tree, &opts))
+        < 0
+        || (filter != NULL
+               && (error = bloom_build(filter, scratch, diff)) < 0)) {
+        goto cleanup;
+    }
 
-    /* run diff */
-    git_diff_tree_to_tree(&diff, repo, prev_tree, cur_tree, NULL);
+    /* with rename detection, the lines are counted per file */
+    if (renames != NULL && renames->mode != NO_RENAMES) {
+        if ((error = diff_with_renames(&result, repo, scratch, diff,
+                 prev_tree, cur_tree, extension, renames, languages, script))
+            < 0) {
+            goto cleanup;
+        }
+        goto count;
+    }
+    if (script != NULL) {
+        if ((error = diff_files(&result, diff, extension, languages, script))
+            < 0) {
+            goto cleanup;
+        }
+        goto count;
+    }
 
     /* get stats */
-    git_diff_stats* stats;
-    git_buf b = GIT_BUF_INIT_CONST(NULL, 0);
     git_diff_stats_format_t format = 0;
-    git_diff_get_stats(&stats, diff);
     format |= GIT_DIFF_STATS_NUMBER;
-    git_diff_stats_to_buf(&b, stats, format, 80);
+    if ((error = git_diff_get_stats(&stats, diff)) < 0
+        || (error = git_diff_stats_to_buf(&b, stats, format, 80)) < 0) {
+        goto cleanup;
+    }
 
 #ifdef TRACE
     if (b.ptr != NULL) {
@@ -95,24 +968,40 @@ diffresult calculate_diff(git_repository* repo, const git_oid* prev,
     }
 #endif
 
-    if (strlen(extension) > 0) {
+    if (strlen(extension) > 0 || languages != NULL) {
         /* look at each line and add changes
          * if extension type matches */
         if (b.ptr == NULL) {
-            return result;
+            goto cleanup;
         }
 
-        char* line = strtok(strdup(b.ptr), "\n");
+        /* diffs run in parallel, so strtok() cannot be used */
+        char* lines = arena_strdup(scratch, b.ptr);
+        char* saveptr;
+        char* line = strtok_r(lines, "\n", &saveptr);
         unsigned long int cur_insertions = 0;
         unsigned long int cur_deletions = 0;
+        int language;
         int ret;
         char path[4096];
 
+        if (lines == NULL) {
+            error = -1;
+            goto cleanup;
+        }
+
         while (line) {
             ret = sscanf(
                 line, "%8lu%8lu%s", &cur_insertions, &cur_deletions, path);
-            line = strtok(NULL, "\n");
-            if (ret == 3 && strlen(path) > strlen(extension)
+            line = strtok_r(NULL, "\n", &saveptr);
+            if (ret == 3 && languages != NULL
+                && (language = language_of(path)) >= 0) {
+                diffresult* l = &languages[language];
+                l->insertions = l->insertions + cur_insertions;
+                l->deletions = l->deletions + cur_deletions;
+            }
+            if (ret == 3 && strlen(extension) > 0
+                && strlen(path) > strlen(extension)
                 && !strcmp(
                        path + strlen(path) - strlen(extension), extension)) {
 #ifdef TRACE
@@ -125,20 +1014,17 @@ diffresult calculate_diff(git_repository* repo, const git_oid* prev,
                 result.deletions = result.deletions + cur_deletions;
             }
         }
-    } else {
+    }
+    if (strlen(extension) == 0) {
         result.insertions = git_diff_stats_insertions(stats);
         result.deletions = git_diff_stats_deletions(stats);
     }
 
-    /* cleanup */
-    git_buf_free(&b);
-    git_diff_stats_free(stats);
-    git_diff_free(diff);
-    git_tree_free(prev_tree);
-    git_tree_free(cur_tree);
-    git_commit_free(commit);
-
+count:
     result.changes = result.insertions + result.deletions;
+    for (i = 0; languages != NULL && i < NUM_LANGUAGES; i++) {
+        languages[i].changes = languages[i].insertions + languages[i].deletions;
+    }
 
 #ifdef TRACE
     print_debug("%s %s - %d insertions + %d deletions "
@@ -147,113 +1033,361 @@ diffresult calculate_diff(git_repository* repo, const git_oid* prev,
 #endif
 
 #if defined(DEBUG) || defined(TRACE)
-    int time_diff = (prev_time - cur_time) / (60 * 60 * 24);
-    char s[2] = "";
-    if (time_diff != 1)
-        s[0] = 's';
-
-    int time_string_length = strlen("2014-10-23 19:13") + 1;
-    char prev_time_string[time_string_length];
-    char cur_time_string[time_string_length];
-    tm = localtime(&prev_time);
-    strftime(prev_time_string, time_string_length, "%F %H:%M", tm);
-    tm = gmtime(&cur_time);
-    strftime(cur_time_string, time_string_length, "%F %H:%M", tm);
-    print_debug("%s %s - diff(%s, %s) = %d changed lines "
-                "(Time range: %s - %s, %d day%s)\n",
-        debug, id, cur_buf, prev_buf, result.changes, cur_time_string,
-        prev_time_string, time_diff, s);
+    {
+        git_commit* prev_commit = NULL;
+        git_commit* cur_commit = NULL;
+        git_time_t prev_time = 0;
+        git_time_t cur_time = 0;
+        if (git_commit_lookup(&prev_commit, repo, prev) == 0
+            && git_commit_lookup(&cur_commit, repo, cur) == 0) {
+            prev_time = git_commit_time(prev_commit);
+            cur_time = git_commit_time(cur_commit);
+        }
+        git_commit_free(prev_commit);
+        git_commit_free(cur_commit);
+
+        int time_diff = (prev_time - cur_time) / (60 * 60 * 24);
+        char s[2] = "";
+        if (time_diff != 1)
+            s[0] = 's';
+
+        int time_string_length = strlen("2014-10-23 19:13") + 1;
+        char prev_time_string[time_string_length];
+        char cur_time_string[time_string_length];
+        tm = localtime(&prev_time);
+        strftime(prev_time_string, time_string_length, "%F %H:%M", tm);
+        tm = gmtime(&cur_time);
+        strftime(cur_time_string, time_string_length, "%F %H:%M", tm);
+        print_debug("%s %s - diff(%s, %s) = %d changed lines "
+                    "(Time range: %s - %s, %d day%s)\n",
+            debug, id, cur_buf, prev_buf, result.changes, cur_time_string,
+            prev_time_string, time_diff, s);
+    }
 #endif
 
-    return result;
-}
-
-void print_results(git_repository* repo, const git_oid* first,
-    const git_oid* last, const int num_commits, const diffresult diff,
-    int number_authors, const char* extension) {
-    if (num_commits > 1) {
-        git_commit* first_commit;
-        git_commit* last_commit;
-        git_time_t first_commit_time;
-        git_time_t last_commit_time;
-        int time_string_length = strlen("2014-10-23") + 1;
-        char first_time_string[time_string_length];
-        char last_time_string[time_string_length];
-        char first_sha[10] = {0};
-        char last_sha[10] = {0};
-        git_oid_tostr(first_sha, 9, first);
-        git_oid_tostr(last_sha, 9, last);
-        struct tm* tm;
-
-        git_commit_lookup(&first_commit, repo, first);
-        git_commit_lookup(&last_commit, repo, last);
-        first_commit_time = git_commit_time(first_commit);
-        last_commit_time = git_commit_time(last_commit);
-
-        tm = gmtime(&first_commit_time);
-        strftime(first_time_string, time_string_length, "%F %H:%M", tm);
-        tm = gmtime(&last_commit_time);
-        strftime(last_time_string, time_string_length, "%F %H:%M", tm);
-
-        /* count lines of code */
-        int first_loc = calculate_loc(repo, first, extension);
-        int last_loc = calculate_loc(repo, last, extension);
-        double ratio = first_loc == 0 ? last_loc == 0 ? 0.0 : 1.0
-                                      : (double)last_loc / (double)first_loc;
-
-        /* compute relative code churn */
-        double churn = last_loc;
-        churn = last_loc == 0 ? 0 : (double)diff.changes / (double)last_loc;
-
-        /* print results */
-        char results[1024 + 1];
-        sprintf(results, "%s;%s;%s;%s;%d;%d;%d;%d;%.2f;%lu;"
-                         "%lu;%lu;%.2f\n",
-            first_time_string, last_time_string, first_sha, last_sha,
-            num_commits, number_authors, first_loc, last_loc, ratio,
-            diff.insertions, diff.deletions, diff.changes, churn);
-
-        printf("%s", results);
-
-        /* cleanup */
-        git_commit_free(first_commit);
-        git_commit_free(last_commit);
-    }
-}
-
-diffresult calculate_interval_code_churn(
-    git_repository* repo, const interval interval, const char* extension) {
+cleanup:
+    arena_destroy(&local);
+    git_buf_free(&b);
+    git_diff_stats_free(stats);
+    git_diff_free(diff);
+    git_tree_free(prev_tree);
+    git_tree_free(cur_tree);
+
+    *out = result;
+    return error;
+}
+
+/*
+ * Time order is enough to diff adjacent commits. Diffing against parents
+ * needs topological order, so that a commit is visited before its
+ * parents. If a base is given, its ancestors are not visited.
+ */
+/* commits in the order in which they are analyzed */
+typedef struct {
+    git_revwalk* revwalk; /* NULL if first parents are followed in graph */
+    graph* graph;
+    git_repository* repo;
+    git_oid next;
+    bool done;
+} walker;
+
+static int start_walk(walker* out, churny_ctx* ctx, const git_oid* head,
+    const git_oid* base) {
+    git_revwalk* walk;
+    commitinfo info;
+    unsigned int i;
+    int error;
+
+    memset(out, 0, sizeof(walker));
+    out->repo = ctx->repo;
+    if ((out->graph = churny_graph(ctx)) == NULL) {
+        return -1;
+    }
+
+    /* the first-parent history needs no sorting, so it is walked
+     * in the commit graph without parsing any commits */
+    if (ctx->diff_mode == FIRST_PARENT && base == NULL) {
+        out->next = *head;
+        return 0;
+    }
+
+    if ((error = git_revwalk_new(&walk, ctx->repo)) < 0) {
+        return error;
+    }
+
+    if (ctx->diff_mode == ADJACENT) {
+        git_revwalk_sorting(walk, GIT_SORT_TIME);
+    } else {
+        git_revwalk_sorting(walk, GIT_SORT_TOPOLOGICAL | GIT_SORT_TIME);
+    }
+
+    /* branches that were merged in are not visited at all */
+    if (ctx->diff_mode == FIRST_PARENT) {
+        git_revwalk_simplify_first_parent(walk);
+    }
+
+    if ((error = git_revwalk_push(walk, head)) < 0
+        || (base != NULL
+               && (error = graph_lookup(
+                       &info, out->graph, ctx->repo, base, false))
+                   < 0)) {
+        git_revwalk_free(walk);
+        return error;
+    }
+
+    for (i = 0; base != NULL && i < info.num_parents; i++) {
+        if ((error = git_revwalk_hide(walk, &info.parents[i])) < 0) {
+            git_revwalk_free(walk);
+            return error;
+        }
+    }
+
+    out->revwalk = walk;
+    return 0;
+}
+
+/* returns GIT_ITEROVER after the last commit */
+static int walk_next(git_oid* out, walker* w) {
+    commitinfo info;
+    int error;
+
+    if (w->revwalk != NULL) {
+        return git_revwalk_next(out, w->revwalk);
+    }
+    if (w->done) {
+        return GIT_ITEROVER;
+    }
+    if ((error = graph_lookup(&info, w->graph, w->repo, &w->next, false))
+        < 0) {
+        return error;
+    }
+
+    *out = w->next;
+    if (info.num_parents == 0) {
+        w->done = true;
+    } else {
+        w->next = info.parents[0];
+    }
+    return 0;
+}
+
+static void walk_free(walker* w) { git_revwalk_free(w->revwalk); }
+
+/* pairs that a walk of the whole history diffs, for progress reports,
+ * 0 if that is not known */
+static unsigned long expected_pairs(churny_ctx* ctx, const graph* g) {
+    if (ctx->sample_budget > 0 || g->num_commits == 0) {
+        return 0;
+    }
+    if (ctx->diff_mode == ADJACENT) {
+        return g->num_commits - 1;
+    }
+    if (ctx->diff_mode == ALL_PARENTS) {
+        return g->num_edges;
+    }
+    /* the first-parent history is shorter than the graph */
+    return 0;
+}
+
+/* schedules the diffs of a commit against its parents,
+ * root commits are not diffed, the trees of the parents are taken from
+ * the graph, which the walk visits later anyway */
+static int diff_parents(pipeline* p, bucket* b, churny_ctx* ctx,
+    const git_oid* commit, const commitinfo* info, int author) {
+    unsigned int num_parents = info->num_parents;
+    commitinfo parent;
+    unsigned int i;
+
+    if (ctx->diff_mode == FIRST_PARENT && num_parents > 1) {
+        num_parents = 1;
+    }
+
+    for (i = 0; i < num_parents; i++) {
+        if (graph_lookup(
+                &parent, ctx->graph, ctx->repo, &info->parents[i], false)
+                < 0
+            || pipeline_diff(p, b, &info->parents[i], commit, &parent.tree,
+                   &info->tree, author)
+                < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* where the walk can be continued after an interval was reported */
+typedef struct {
+    git_oid boundary;
+    int year;
+    int month;
+} resumepoint;
+
+typedef struct {
+    checkpoint cp;
+    churny_row_cb cb;
+    void* payload;
+    resumepoint* points; /* one per closed interval of this run */
+    size_t num_points;
+    size_t capacity;
+    size_t saved; /* intervals reported at the last checkpoint */
+    time_t written;
+} checkpointer;
+
+/* keeps the reported rows for the next checkpoint */
+static int record_row(const churnrow* row, void* payload) {
+    checkpointer* c = (checkpointer*)payload;
+
+    /* a partial row is analyzed again on resume */
+    if (!row->partial && checkpoint_add_row(&c->cp, row) < 0) {
+        return -1;
+    }
+    return c->cb(row, c->payload);
+}
+
+/* replays the rows of an earlier run, sets resuming if there were any */
+static int start_checkpoint(checkpointer* c, churny_ctx* ctx,
+    const git_oid* head, const interval interval, const char* extension,
+    bool* resuming) {
+    const char id[] = "start_checkpoint";
+    checkpoint_key key;
+    size_t i;
+    int error;
+
+    /* see main.c, estimates are neither saved nor replayed */
+    if (ctx->sample_budget > 0) {
+        return set_error(ctx,
+            "%s %s - Checkpoints cannot be combined with sampling", fatal, id);
+    }
+
+    checkpoint_init(&c->cp);
+    key = c->cp.key;
+    key.head = *head;
+    key.interval = interval;
+    key.diff_mode = ctx->diff_mode;
+    key.renames = ctx->renames.mode;
+    key.rename_limit = ctx->renames.limit;
+    key.author_sketches = ctx->author_sketches;
+    key.languages = ctx->languages;
+    strncpy(key.extension, extension, sizeof(key.extension) - 1);
+    c->written = time(NULL);
+    *resuming = false;
+
+    if (!ctx->resume || access(ctx->checkpoint_path, F_OK) != 0) {
+        c->cp.key = key;
+        return 0;
+    }
+
+    if (checkpoint_read(&c->cp, ctx->checkpoint_path) < 0) {
+        return set_error(ctx, "%s %s - Could not read checkpoint: %s", fatal,
+            id, ctx->checkpoint_path);
+    }
+    if (memcmp(&c->cp.key, &key, sizeof(key))) {
+        return set_error(ctx, "%s %s - Checkpoint does not match this "
+                              "analysis or HEAD has moved: %s",
+            fatal, id, ctx->checkpoint_path);
+    }
+
+    for (i = 0; i < c->cp.num_rows; i++) {
+        if ((error = c->cb(&c->cp.rows[i], c->payload)) != 0) {
+            return set_error(
+                ctx, "%s %s - Aborted by callback (%d)", fatal, id, error);
+        }
+    }
+
+    *resuming = c->cp.num_rows > 0;
+    return 0;
+}
+
+static int add_resumepoint(
+    checkpointer* c, const git_oid* boundary, const struct tm* tm) {
+    if (c->num_points == c->capacity) {
+        size_t capacity = c->capacity == 0 ? 64 : 2 * c->capacity;
+        resumepoint* points
+            = realloc(c->points, capacity * sizeof(resumepoint));
+        if (points == NULL) {
+            return -1;
+        }
+        c->points = points;
+        c->capacity = capacity;
+    }
+
+    c->points[c->num_points].boundary = *boundary;
+    c->points[c->num_points].year = tm->tm_year;
+    c->points[c->num_points].month = tm->tm_mon;
+    c->num_points = c->num_points + 1;
+    return 0;
+}
+
+/* writes a checkpoint if intervals were reported since the last one and
+ * enough time has passed, or right away if forced to */
+static int save_checkpoint(
+    checkpointer* c, churny_ctx* ctx, size_t reported, bool force) {
+    const char id[] = "save_checkpoint";
+    resumepoint* point;
+
+    if (reported == c->saved || reported > c->num_points
+        || (!force && time(NULL) - c->written < ctx->checkpoint_seconds)) {
+        return 0;
+    }
+
+    point = &c->points[reported - 1];
+    c->cp.boundary = point->boundary;
+    c->cp.year = point->year;
+    c->cp.month = point->month;
+
+    if (checkpoint_write(&c->cp, ctx->checkpoint_path) < 0) {
+        return set_error(ctx, "%s %s - Could not write checkpoint: %s", fatal,
+            id, ctx->checkpoint_path);
+    }
+
+    c->saved = reported;
+    c->written = time(NULL);
+    return 0;
+}
+
+int calculate_interval_code_churn(diffresult* total, churny_ctx* ctx,
+    const interval interval, const char* extension, churny_row_cb cb,
+    void* payload) {
     const char id[] = "calculate_interval_code_churn";
+    git_repository* repo = ctx->repo;
 #if defined(DEBUG) || defined(TRACE)
     print_debug("%s %s - %s\n", debug, id, git_repository_workdir(repo));
 #endif
 
     /* walk over revisions and sum up code churn */
     git_oid prev_oid;
+    git_oid prev_tree;
     git_oid cur_oid;
     git_oid head;
-    git_revwalk* walk = NULL;
-    git_commit* commit;
+    walker walk;
+    commitinfo info;
+    int next = 0;
     setenv("TC", "CEST", 1);
     git_time_t commit_time;
-    const git_signature* signature;
+    git_time_t prev_time = 0;
+    int author;
+    int prev_author = 0;
     git_oid last_commit;
     git_time_t last_commit_time = 0;
+    int error = 0;
     int time_string_length = strlen("2014-10-23 00:00") + 1;
     int num_commits = 0;
-    diffresult total_diff;
-    diffresult diff;
-    total_diff.insertions = 0;
-    total_diff.deletions = 0;
-    total_diff.changes = 0;
-    diff.insertions = 0;
-    diff.deletions = 0;
-    diff.changes = 0;
+    pipeline* p;
+    bucket* b;
     struct tm* tm;
     struct tm tm_min_time;
     char from_time_string[time_string_length];
     char to_time_string[time_string_length];
     git_time_t min_time = time(NULL);
+    checkpointer c;
+    churny_row_cb emit_cb = cb;
+    void* emit_payload = payload;
+    bool resuming = false;
+    bool closed;
+    bool expired = false;
+    unsigned long expected;
+    unsigned long skipped = 0;
 
     tm = gmtime(&min_time);
     tm_min_time = *tm;
@@ -283,18 +1417,73 @@ diffresult calculate_interval_code_churn(
         from_time_string, min_time);
 #endif
 
-    git_reference_name_to_id(&head, repo, "HEAD");
-    git_revwalk_new(&walk, repo);
-    git_revwalk_sorting(walk, GIT_SORT_TIME);
-    git_revwalk_push(walk, &head);
+    if (git_reference_name_to_id(&head, repo, "HEAD") < 0
+        || start_walk(&walk, ctx, &head, NULL) < 0) {
+        return set_git_error(ctx, id);
+    }
 
-    List* list = list_create();
+    p = pipeline_create(ctx, extension);
+    if (p == NULL || (b = pipeline_open(p)) == NULL) {
+        if (p != NULL) {
+            pipeline_destroy(p);
+        }
+        walk_free(&walk);
+        return set_error(ctx, "%s %s - Out of memory", fatal, id);
+    }
+    expected = expected_pairs(ctx, walk.graph);
+    pipeline_expect(p, expected);
+    ctx->expired = false;
+    /* survival needs the scripts from HEAD on, which a resumed walk skips */
+    if (ctx->checkpoint_path != NULL) {
+        p->survival = false;
+    }
 
-    /* iterates over all commits starting with the latest one */
-    while (!git_revwalk_next(&cur_oid, walk)) {
+    /* reported rows go through the checkpointer,
+     * so that they can be replayed on resume */
+    memset(&c, 0, sizeof(c));
+    if (ctx->checkpoint_path != NULL) {
+        c.cb = cb;
+        c.payload = payload;
+        emit_cb = record_row;
+        emit_payload = &c;
+        error = start_checkpoint(
+            &c, ctx, &head, interval, extension, &resuming);
+    }
+    if (resuming) {
+        tm_min_time.tm_year = c.cp.year;
+        tm_min_time.tm_mon = c.cp.month;
+        tm_min_time.tm_isdst = -1;
+        min_time = tm_to_utc(&tm_min_time);
+    }
+
+    /* iterates over all commits starting with the latest one,
+     * diffs and lines of code are computed by the workers meanwhile */
+    while (error == 0 && (next = walk_next(&cur_oid, &walk)) == 0) {
+
+        /* what has been walked so far is reported as it is */
+        if ((expired = pipeline_expired(p))) {
+            break;
+        }
+
+        /* skip the intervals that were reported before the checkpoint,
+         * all other state is empty at their boundary */
+        if (resuming) {
+            if (!git_oid_equal(&cur_oid, &c.cp.boundary)) {
+                skipped = skipped + 1;
+                continue;
+            }
+            resuming = false;
+            if (expected > skipped) {
+                pipeline_expect(p, expected - skipped);
+            }
+        }
+        closed = false;
 
-        git_commit_lookup(&commit, repo, &cur_oid);
-        commit_time = git_commit_time(commit);
+        if (graph_lookup(&info, walk.graph, repo, &cur_oid, true) < 0) {
+            error = set_git_error(ctx, id);
+            break;
+        }
+        commit_time = info.time;
 
         if (last_commit_time == 0) {
             last_commit_time = commit_time;
@@ -309,15 +1498,15 @@ diffresult calculate_interval_code_churn(
             commit_time_string, commit_time);
 #endif
 
-        if (num_commits >= 2) {
-            diffresult cur_diff
-                = calculate_diff(repo, &cur_oid, &prev_oid, extension);
-            diff.insertions = diff.insertions + cur_diff.insertions;
-            diff.deletions = diff.deletions + cur_diff.deletions;
-            diff.changes = diff.changes + cur_diff.changes;
-            total_diff.insertions = total_diff.insertions + cur_diff.insertions;
-            total_diff.deletions = total_diff.deletions + cur_diff.deletions;
-            total_diff.changes = total_diff.changes + cur_diff.changes;
+        /* the first pair of an interval is not counted, but survival
+         * needs it to follow the lines */
+        if (ctx->diff_mode == ADJACENT && num_commits >= 1) {
+            if ((error = pipeline_diff(p, b, &cur_oid, &prev_oid, &info.tree,
+                     &prev_tree, num_commits >= 2 ? prev_author : -1))
+                < 0) {
+                set_error(ctx, "%s %s - Could not schedule jobs", fatal, id);
+                break;
+            }
         }
 
         /* if the commit is not in the time interval,
@@ -328,20 +1517,22 @@ diffresult calculate_interval_code_churn(
                         "specified time window: %s\n",
                 debug, id, commit_time_string);
 #endif
-            /* print results, reset counters
-             *  and continue */
-            print_results(repo, &cur_oid, &last_commit, num_commits, diff,
-                list->size, extension);
-
-            /* reset counters */
+            /* close the interval, reset counters
+             * and continue */
             if (num_commits > 1) {
+                if ((error = pipeline_close(p, b, &cur_oid, commit_time,
+                         &last_commit, last_commit_time, num_commits))
+                        < 0
+                    || (b = pipeline_open(p)) == NULL) {
+                    error = set_error(ctx, "%s %s - Could not schedule jobs",
+                        fatal, id);
+                    break;
+                }
+
                 last_commit = cur_oid;
                 last_commit_time = commit_time;
-                diff.insertions = 0;
-                diff.deletions = 0;
-                diff.changes = 0;
                 num_commits = 0;
-                list_clear(list);
+                closed = true;
             }
 
             while (commit_time < min_time) {
@@ -370,19 +1561,71 @@ diffresult calculate_interval_code_churn(
             print_debug(
                 "%s %s - Analyzing until %s\n", debug, id, from_time_string);
 #endif
+
+            if (closed && ctx->checkpoint_path != NULL
+                && add_resumepoint(&c, &cur_oid, &tm_min_time) < 0) {
+                error = set_error(ctx, "%s %s - Out of memory", fatal, id);
+                break;
+            }
         }
 
-        signature = git_commit_author(commit);
-        if (!list_contains(list, signature->name, string_compare)) {
-            list_add(list, signature->name);
+        /* the commit belongs to the interval that is open now */
+        if ((author = pipeline_commit(p, b, info.author, commit_time)) < 0) {
+            error = set_error(ctx, "%s %s - Out of memory", fatal, id);
+            break;
+        }
+        if (ctx->diff_mode != ADJACENT
+            && (error = diff_parents(p, b, ctx, &cur_oid, &info, author))
+                < 0) {
+            set_error(ctx, "%s %s - Could not schedule jobs", fatal, id);
+            break;
+        }
+
+        if (ctx->author_sketches) {
+            hll_add(&b->authors, info.author);
         }
 
         num_commits = num_commits + 1;
         prev_oid = cur_oid;
+        prev_tree = info.tree;
+        prev_time = commit_time;
+        prev_author = author;
+
+        /* report finished intervals while walking on */
+        if ((error = pipeline_emit(p, emit_cb, emit_payload, false)) != 0
+            || (ctx->checkpoint_path != NULL
+                   && (error = save_checkpoint(&c, ctx, p->next, false))
+                       < 0)) {
+            break;
+        }
+    }
+
+    if (error == 0 && !expired && next != GIT_ITEROVER) {
+        error = set_git_error(ctx, id);
+    }
+    if (error == 0 && !expired && resuming) {
+        error = set_error(ctx, "%s %s - Checkpoint does not match the history",
+            fatal, id);
     }
 
-    print_results(
-        repo, &cur_oid, &last_commit, num_commits, diff, list->size, extension);
+    if (error == 0
+        && (error = pipeline_close(p, b, &prev_oid, prev_time, &last_commit,
+                last_commit_time, num_commits))
+            < 0) {
+        set_error(ctx, "%s %s - Could not schedule jobs", fatal, id);
+    }
+    if (error == 0) {
+        error = pipeline_emit(p, emit_cb, emit_payload, true);
+    }
+    ctx->expired = p->truncated;
+
+    /* the analysis is complete, there is nothing left to resume,
+     * unless it was stopped by the deadline after the partial row */
+    if (error == 0 && ctx->checkpoint_path != NULL && p->truncated) {
+        error = save_checkpoint(&c, ctx, p->next - 1, true);
+    } else if (error == 0 && ctx->checkpoint_path != NULL) {
+        unlink(ctx->checkpoint_path);
+    }
 
 #if defined(DEBUG) || defined(TRACE)
     char s[2] = "";
@@ -391,57 +1634,104 @@ diffresult calculate_interval_code_churn(
     }
     print_debug("%s %s - %d commits found\n", debug, id, num_commits);
     print_debug("%%s %s - lu total lines of changed code\n", debug, id,
-        total_diff.changes);
+        p->total.changes);
 #endif
 
     /* cleanup */
-    git_commit_free(commit);
-    git_revwalk_free(walk);
-    list_destroy(list);
+    walk_free(&walk);
+    checkpoint_free(&c.cp);
+    free(c.points);
 
-    return total_diff;
+    if (total != NULL) {
+        *total = p->total;
+    }
+    pipeline_destroy(p);
+    return error;
 }
 
-diffresult calculate_code_churn(git_repository* repo, const char* extension) {
+int calculate_code_churn(diffresult* total, churny_ctx* ctx,
+    const git_oid* from, const git_oid* to, const char* extension,
+    churny_row_cb cb, void* payload) {
     const char id[] = "calculate_code_churn";
+    git_repository* repo = ctx->repo;
 #if defined(DEBUG) || defined(TRACE)
     print_debug("%s %s - %s\n", debug, id, git_repository_workdir(repo));
 #endif
 
     /* walk over revisions and sum up code churn */
     git_oid prev_oid;
+    git_oid prev_tree;
     git_oid cur_oid;
     git_oid head;
-    git_revwalk* walk = NULL;
-    git_commit* commit;
-    const git_signature* signature;
+    walker walk;
+    commitinfo info;
+    int next = 0;
     git_time_t commit_time;
     git_time_t first_commit_time = 0;
+    git_time_t base_time = 0;
+    int author;
+    int prev_author = 0;
     git_oid first_commit;
     git_oid last_commit;
     git_time_t last_commit_time = 0;
+    bool found = false;
+    bool expired = false;
+    int error = 0;
     int time_string_length = strlen("2014-10-23 00:00") + 1;
     int num_commits = 0;
-    diffresult total_diff;
-    total_diff.insertions = 0;
-    total_diff.deletions = 0;
-    total_diff.changes = 0;
+    pipeline* p;
+    bucket* b;
     struct tm* tm;
     char from_time_string[time_string_length];
     char to_time_string[time_string_length];
 
-    git_reference_name_to_id(&head, repo, "HEAD");
-    git_revwalk_new(&walk, repo);
-    git_revwalk_sorting(walk, GIT_SORT_TIME);
-    git_revwalk_push(walk, &head);
+    if (to != NULL) {
+        head = *to;
+    } else if (git_reference_name_to_id(&head, repo, "HEAD") < 0) {
+        return set_git_error(ctx, id);
+    }
 
-    List* list = list_create();
+    /* when diffing against parents, history behind the base is hidden
+     * from the walk, and commits merged in later may still follow it */
+    if (from != NULL && ctx->diff_mode != ADJACENT
+        && !git_oid_equal(from, &head)
+        && git_graph_descendant_of(repo, &head, from) != 1) {
+        return set_error(
+            ctx, "%s %s - Base commit is not an ancestor", fatal, id);
+    }
+    if (start_walk(&walk, ctx, &head,
+            ctx->diff_mode != ADJACENT ? from : NULL)
+        < 0) {
+        return set_git_error(ctx, id);
+    }
+
+    p = pipeline_create(ctx, extension);
+    if (p == NULL || (b = pipeline_open(p)) == NULL) {
+        if (p != NULL) {
+            pipeline_destroy(p);
+        }
+        walk_free(&walk);
+        return set_error(ctx, "%s %s - Out of memory", fatal, id);
+    }
+    pipeline_expect(p, from == NULL ? expected_pairs(ctx, walk.graph) : 0);
+    ctx->expired = false;
+    /* survival is only tracked by interval analyses,
+     * adjacent commits are diffed from the newer one here */
+    p->survival = false;
 
     /* iterates over all commits starting with the latest one */
-    while (!git_revwalk_next(&cur_oid, walk)) {
+    while ((next = walk_next(&cur_oid, &walk)) == 0) {
 
-        git_commit_lookup(&commit, repo, &cur_oid);
-        commit_time = git_commit_time(commit);
+        /* what has been walked so far is reported as it is */
+        if ((expired = pipeline_expired(p))) {
+            break;
+        }
+
+        if (graph_lookup(&info, walk.graph, repo, &cur_oid, true) < 0) {
+            error = set_git_error(ctx, id);
+            break;
+        }
+        commit_time = info.time;
 
         if (last_commit_time == 0) {
             last_commit_time = commit_time;
@@ -459,22 +1749,57 @@ diffresult calculate_code_churn(git_repository* repo, const char* extension) {
         first_commit_time = commit_time;
         first_commit = cur_oid;
 
-        signature = git_commit_author(commit);
-        if (!list_contains(list, signature->name, string_compare)) {
-            list_add(list, signature->name);
+        if ((author = pipeline_commit(p, b, info.author, commit_time)) < 0) {
+            error = set_error(ctx, "%s %s - Out of memory", fatal, id);
+            break;
+        }
+        if (ctx->diff_mode != ADJACENT
+            && (from == NULL || !git_oid_equal(&cur_oid, from))
+            && (error = diff_parents(p, b, ctx, &cur_oid, &info, author))
+                < 0) {
+            set_error(ctx, "%s %s - Could not schedule jobs", fatal, id);
+            break;
+        }
+
+        if (ctx->author_sketches) {
+            hll_add(&b->authors, info.author);
         }
 
         num_commits = num_commits + 1;
 
-        if (num_commits >= 2) {
-            diffresult cur_diff
-                = calculate_diff(repo, &prev_oid, &cur_oid, extension);
-            total_diff.insertions = total_diff.insertions + cur_diff.insertions;
-            total_diff.deletions = total_diff.deletions + cur_diff.deletions;
-            total_diff.changes = total_diff.changes + cur_diff.changes;
+        if (ctx->diff_mode == ADJACENT && num_commits >= 2) {
+            if ((error = pipeline_diff(p, b, &prev_oid, &cur_oid, &prev_tree,
+                     &info.tree, prev_author))
+                < 0) {
+                set_error(ctx, "%s %s - Could not schedule jobs", fatal, id);
+                break;
+            }
         }
 
         prev_oid = cur_oid;
+        prev_tree = info.tree;
+        prev_author = author;
+
+        /* stop at the base of the requested range */
+        if (from != NULL && git_oid_equal(&cur_oid, from)) {
+            found = true;
+            base_time = commit_time;
+            if (ctx->diff_mode == ADJACENT) {
+                break;
+            }
+        }
+    }
+
+    if (error == 0 && !expired && next != GIT_ITEROVER && !found) {
+        error = set_git_error(ctx, id);
+    }
+    if (error == 0 && !expired && from != NULL && !found) {
+        error = set_error(
+            ctx, "%s %s - Base commit is not an ancestor", fatal, id);
+    }
+    if (found) {
+        first_commit = *from;
+        first_commit_time = base_time;
     }
 
 #if defined(DEBUG) || defined(TRACE)
@@ -486,174 +1811,23 @@ diffresult calculate_code_churn(git_repository* repo, const char* extension) {
 #endif
 
     /* print results */
-    print_results(repo, &first_commit, &last_commit, num_commits, total_diff,
-        list->size, extension);
-
-    /* cleanup */
-    list_destroy(list);
-    git_commit_free(commit);
-    git_revwalk_free(walk);
-
-    return total_diff;
-}
-
-int main(int argc, char** argv) {
-    const char id[] = "main";
-
-#if defined(DEBUG) || defined(TRACE)
-    /* print program call */
-    print_debug("%s %s - program call ", debug, id);
-    int i;
-    for (i = 0; i < argc; i++) {
-        print_debug("%s", argv[i]);
-        if (i < argc - 1) {
-            print_debug(" ");
-        }
+    if (error == 0
+        && (error = pipeline_close(p, b, &first_commit, first_commit_time,
+                &last_commit, last_commit_time, num_commits))
+            < 0) {
+        set_error(ctx, "%s %s - Could not schedule jobs", fatal, id);
     }
-    print_debug("\n");
-#endif
-
-    /* parse arguments */
-    int c;
-    interval interval = 0;
-    bool count_only = false;
-    char extension[255] = "";
-
-    while ((c = getopt(argc, argv, "chjl:my")) != -1) {
-        switch (c) {
-        case 'h':
-            usage(argv[0]);
-            return EXIT_SUCCESS;
-        case 'c':
-            count_only = true;
-            break;
-        case 'l':
-            strcpy(extension, optarg);
-            break;
-        case 'm':
-            interval = MONTH;
-            break;
-        case 'y':
-            interval = YEAR;
-            break;
-        default:
-            printf("?? getopt returned character code "
-                   "0%o ??\n",
-                c);
-        }
+    if (error == 0) {
+        error = pipeline_emit(p, cb, payload, true);
     }
+    ctx->expired = p->truncated;
 
-    char* path = NULL;
-    git_repository* repo = NULL;
-
-#if defined(DEBUG) || defined(TRACE)
-    print_debug("argc = %d\noptind = %d\n", argc, optind);
-#endif
-
-    switch (argc - optind) {
-    case 0:
-        /* at least one argument is required */
-        fprintf(stderr, "%s %s - At least one argument is "
-                        "required!\n",
-            fatal, id);
-        usage(argv[0]);
-        return EXIT_FAILURE;
-    case 1:
-        /* a git repository is expected */
-        path = argv[optind];
-
-#if defined(DEBUG) || defined(TRACE)
-        print_debug("%s %s - path = \"%s\"\n", debug, id, path);
-#endif
-        /* make sure path exists and is a directory */
-        struct stat s;
-        int err = stat(path, &s);
-        if (err != -1 && S_ISDIR(s.st_mode)) {
-
-#if defined(DEBUG) || defined(TRACE)
-            print_debug("%s %s - Directory exists: %s\n", debug, id, path);
-#endif
-
-            /* make sure that there is a .git directory
-             * in there */
-            char gitmetadir[strlen(path) + 6];
-            strcpy(gitmetadir, path);
-            strcat(gitmetadir, "/.git");
-            err = stat(gitmetadir, &s);
-            if (err != -1 && S_ISDIR(s.st_mode)) {
-                /* seems to be a git repository */
-#if defined(DEBUG) || defined(TRACE)
-                print_debug("%s %s - Is a git "
-                            "repository: %s\n",
-                    debug, id, path);
-#endif
-
-                /* initialize repo */
-                git_libgit2_init();
-                if (git_repository_open(&repo, path) == 0) {
-
-#if defined(DEBUG) || defined(TRACE)
-                    print_debug("%s %s - "
-                                "Initialized "
-                                "repository: "
-                                "%s\n",
-                        debug, id, path);
-#endif
-
-                } else {
-                    exit_error(EXIT_FAILURE, "%s %s - Could "
-                                             "not open "
-                                             "repository: %s\n",
-                        fatal, id, path);
-                }
-            } else {
-                exit_error(EXIT_FAILURE, "%s %s - Is not a git "
-                                         "repository: %s\n",
-                    fatal, id, path);
-            }
-        } else if (err == -1) {
-            perror("stat");
-            exit(err);
-        } else {
-            exit_error(EXIT_FAILURE, "%s %s - Is not a "
-                                     "directory: %s\n",
-                fatal, id, path);
-        }
-        break;
-    case 2:
-        /* either two tars or two directories are expected */
-#if defined(DEBUG) || defined(TRACE)
-        print_debug("%s %s - Expecting two tars or two "
-                    "directories\n",
-            debug, id);
-#endif
-        break;
-    default:
-        fprintf(stderr, "%s %s - Wrong amount of arguments: "
-                        "%d!\n",
-            fatal, id, argc - optind);
-        usage(argv[0]);
-        return EXIT_FAILURE;
-    }
-
-    if (repo != NULL) {
-        /* run the actual analysis */
-        if (count_only) {
-            /* only count LOC, print result and exit */
-            printf("%d\n",
-                calculate_loc_dir(git_repository_workdir(repo), extension));
-        } else if (interval > 0) {
-            print_csv_header();
-            calculate_interval_code_churn(repo, interval, extension);
-        } else {
-            print_csv_header();
-            calculate_code_churn(repo, extension);
-        }
+    /* cleanup */
+    walk_free(&walk);
 
-        /* cleanup */
-        git_repository_free(repo);
+    if (total != NULL) {
+        *total = p->total;
     }
-
-    git_libgit2_shutdown();
-    return EXIT_SUCCESS;
+    pipeline_destroy(p);
+    return error;
 }
@@ -31,25 +31,166 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
 #include <git2.h>
 #include "utils.h"
 #include "loc.h"
+#include "arena.h"
 #include "list.h"
+#include "oidmap.h"
+#include "output.h"
+#include "pool.h"
+#include "sample.h"
+#include "renames.h"
+#include "checkpoint.h"
+#include "bloom.h"
+#include "graph.h"
+#include "timeline.h"
+#include "progress.h"
 
 typedef int interval;
 #define YEAR 1
 #define MONTH 2
 
-static void usage(const char* basename);
-static void print_csv_header();
-diffresult calculate_diff(git_repository* repo, const git_oid* prev,
+/* which commits are diffed against each other */
+typedef int diffmode;
+#define ADJACENT 0     /* each commit against its predecessor in time */
+#define FIRST_PARENT 1 /* each commit against its first parent */
+#define ALL_PARENTS 2  /* each commit against each of its parents */
+
+/* libgit2's object cache limit is one for the whole process, shared by
+ * the repositories of all workers, its default is 256 MB */
+#define CACHE_LIMIT (512 * 1024 * 1024)
+/* trees larger than this are not kept in the object cache */
+#define CACHE_TREE_LIMIT (1024 * 1024)
+/* blobs whose lines are counted by the same worker of the blob pool,
+ * trees with fewer blobs to count than two runs are counted in place */
+#define BLOB_BATCH 256
+
+/* diff of a commit against its predecessor */
+typedef struct {
+    git_oid prev;
+    renameopts renames;
+    diffresult result;
+    diffresult* languages; /* per language, NULL if they were not counted */
+} diffentry;
+
+/* cached results, only valid for the same extension */
+typedef struct {
+    char* extension;
+    oidmap* loc;   /* commit id -> lines of code */
+    oidmap* diffs; /* commit id -> diffentry */
+    oidmap* languages; /* commit id -> lines of code per language */
+    arena entries; /* the diffentries, they live as long as the cache */
+} churny_cache;
+
+/* cache hits and misses since the context was opened */
+typedef struct {
+    unsigned long diff_hits;
+    unsigned long diff_misses;
+    unsigned long loc_hits;
+    unsigned long loc_misses;
+    unsigned long tree_hits;
+    unsigned long tree_misses;
+    unsigned long bloom_skips; /* diffs skipped by changed-path filters */
+    unsigned long commits_parsed; /* commits that were not in the graph */
+} churny_stats;
+
+/* analysis context, keeps the repository, caches and workers across calls */
+typedef struct {
+    git_repository* repo;
+    char* path;
+    List* caches;
+    int num_threads;
+    int sample_budget;
+    diffmode diff_mode;
+    renameopts renames;
+    char* checkpoint_path;
+    int checkpoint_seconds;
+    bool resume;
+    bool author_sketches;
+    bool author_churn;
+    bool languages;     /* a row per language instead of an extension */
+    bool survival;      /* count the added lines that survive */
+    bool coupling;      /* count the files changed together */
+    oidmap* blob_lines; /* blob id -> lines of code */
+    bloom_index* bloom; /* changed-path filters, if enabled */
+    graph* graph;       /* opened on first use */
+    bool graph_cache;
+    time_t deadline;       /* 0 if analyses may take as long as they need */
+    bool expired;          /* the last analysis was stopped by the deadline */
+    FILE* progress_stream; /* for progress reports, may be NULL */
+    char* status_path;     /* for progress reports, may be NULL */
+    int progress_seconds;
+    pool* pool;
+    pool* blob_pool; /* counts the lines of blobs for the workers of pool */
+    churny_stats stats;
+    pthread_mutex_t lock;
+    char error[1024];
+} churny_ctx;
+
+/* called for each result row, a non-zero return value stops the analysis */
+typedef int (*churny_row_cb)(const churnrow* row, void* payload);
+
+int churny_open(churny_ctx** out, const char* path);
+void churny_free(churny_ctx* ctx);
+const char* churny_error(const churny_ctx* ctx);
+void churny_set_threads(churny_ctx* ctx, int num_threads);
+void churny_set_sampling(churny_ctx* ctx, int budget);
+void churny_set_diff_mode(churny_ctx* ctx, diffmode mode);
+void churny_set_renames(churny_ctx* ctx, renamemode mode, size_t limit);
+void churny_set_author_sketches(churny_ctx* ctx, bool enabled);
+void churny_set_author_churn(churny_ctx* ctx, bool enabled);
+void churny_set_languages(churny_ctx* ctx, bool enabled);
+void churny_set_survival(churny_ctx* ctx, bool enabled);
+void churny_set_coupling(churny_ctx* ctx, bool enabled);
+int churny_set_changed_paths(churny_ctx* ctx, bool enabled);
+int churny_set_graph_cache(churny_ctx* ctx, bool enabled);
+graph* churny_graph(churny_ctx* ctx);
+int churny_set_checkpoint(
+    churny_ctx* ctx, const char* path, int seconds, bool resume);
+void churny_set_deadline(churny_ctx* ctx, time_t deadline);
+int churny_set_progress(
+    churny_ctx* ctx, FILE* stream, const char* path, int seconds);
+pool* churny_pool(churny_ctx* ctx);
+int churny_loc(int* out, churny_ctx* ctx, const git_oid* commit,
+    const char* extension);
+int churny_diff(diffresult* out, churny_ctx* ctx, const git_oid* prev,
     const git_oid* cur, const char* extension);
-void print_results(git_repository* repo, const git_oid* first,
-    const git_oid* last, const int num_commits, const diffresult diff,
-    int number_authors, const char* extension);
-diffresult calculate_interval_code_churn(
-    git_repository* repo, const interval interval, const char* extension);
-diffresult calculate_code_churn(git_repository* repo, const char* extension);
-int main(int argc, char** argv);
+int churny_churn(churnrow* out, churny_ctx* ctx, const git_oid* from,
+    const git_oid* to, const char* extension);
+int churny_foreach_interval(churny_ctx* ctx, const interval interval,
+    const char* extension, churny_row_cb cb, void* payload);
+int churny_intervals(churnrow** rows, size_t* num_rows, churny_ctx* ctx,
+    const interval interval, const char* extension);
+void churny_rows_free(churnrow* rows);
+void churny_get_stats(churny_stats* out, churny_ctx* ctx);
+void churny_print_stats(FILE* stream, const churny_stats* stats);
+
+int set_error(churny_ctx* ctx, const char* format, ...);
+int set_git_error(churny_ctx* ctx, const char* id);
+int calculate_diff(diffresult* out, git_repository* repo, treecache* trees,
+    arena* scratch, const git_oid* prev, const git_oid* cur,
+    const git_oid* prev_id, const git_oid* cur_id, const char* extension,
+    const renameopts* renames, bloom_filter* filter, diffresult* languages,
+    editscript* script);
+int calculate_cached_diff(diffresult* out, churny_ctx* ctx,
+    git_repository* repo, treecache* trees, arena* scratch,
+    const git_oid* prev, const git_oid* cur, const git_oid* prev_tree,
+    const git_oid* cur_tree, const char* extension,
+    diffresult* languages, editscript* script);
+int calculate_cached_loc(int* out, churny_ctx* ctx, git_repository* repo,
+    const git_oid* commit, const char* extension);
+int calculate_cached_languages(int* out, churny_ctx* ctx,
+    git_repository* repo, const git_oid* commit);
+void calculate_ratios(churnrow* row);
+int calculate_interval_code_churn(diffresult* total, churny_ctx* ctx,
+    const interval interval, const char* extension, churny_row_cb cb,
+    void* payload);
+int calculate_code_churn(diffresult* total, churny_ctx* ctx,
+    const git_oid* from, const git_oid* to, const char* extension,
+    churny_row_cb cb, void* payload);
 
 #endif
@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#include "coupling.h"
+
+static couplingslot* find_slot(couplingslot* slots, size_t num_slots,
+    const couplingnode* nodes, uint64_t hash, const char* name,
+    size_t length) {
+    size_t i = hash & (num_slots - 1);
+
+    while (slots[i].index >= 0
+        && (slots[i].hash != hash
+               || strncmp(nodes[slots[i].index].name, name, length) != 0
+               || nodes[slots[i].index].name[length] != '\0')) {
+        i = (i + 1) & (num_slots - 1);
+    }
+
+    return &slots[i];
+}
+
+static int grow_slots(couplingmatrix* m) {
+    size_t num_slots = m->num_slots == 0 ? 64 : 2 * m->num_slots;
+    couplingslot* slots = malloc(num_slots * sizeof(couplingslot));
+    size_t i;
+
+    if (slots == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < num_slots; i++) {
+        slots[i].index = -1;
+    }
+    for (i = 0; i < m->num_slots; i++) {
+        if (m->slots[i].index >= 0) {
+            const char* name = m->nodes[m->slots[i].index].name;
+            *find_slot(slots, num_slots, m->nodes, m->slots[i].hash, name,
+                strlen(name))
+                = m->slots[i];
+        }
+    }
+
+    free(m->slots);
+    m->slots = slots;
+    m->num_slots = num_slots;
+    return 0;
+}
+
+/* returns the index of the node named by the first length characters
+ * of name, which is added if necessary */
+static int add_node(couplingmatrix* m, const char* name, size_t length) {
+    uint64_t hash = hash_string(name, length);
+    couplingslot* slot;
+    char* copy;
+
+    /* keep the load factor below 3/4 */
+    if (4 * (m->size + 1) > 3 * m->num_slots && grow_slots(m) < 0) {
+        return -1;
+    }
+
+    slot = find_slot(m->slots, m->num_slots, m->nodes, hash, name, length);
+    if (slot->index >= 0) {
+        return slot->index;
+    }
+
+    if (m->size == m->capacity) {
+        size_t capacity = m->capacity == 0 ? 64 : 2 * m->capacity;
+        couplingnode* nodes
+            = realloc(m->nodes, capacity * sizeof(couplingnode));
+        if (nodes == NULL) {
+            return -1;
+        }
+        m->nodes = nodes;
+        m->capacity = capacity;
+    }
+
+    if ((copy = (char*)arena_alloc(&m->names, length + 1)) == NULL) {
+        return -1;
+    }
+    memcpy(copy, name, length);
+    copy[length] = '\0';
+    m->nodes[m->size].name = copy;
+    m->nodes[m->size].num_commits = 0;
+    slot->hash = hash;
+    slot->index = (int)m->size;
+    m->size = m->size + 1;
+    return slot->index;
+}
+
+static couplingcell* find_cell(
+    couplingcell* cells, size_t capacity, uint64_t key) {
+    size_t i = (size_t)((key * 0x9e3779b97f4a7c15ULL) >> 32) & (capacity - 1);
+
+    while (cells[i].key != 0 && cells[i].key != key) {
+        i = (i + 1) & (capacity - 1);
+    }
+
+    return &cells[i];
+}
+
+/* moves the pairs that may have been changed together more than floor
+ * times into a table of the given capacity */
+static int rehash(couplingmatrix* m, size_t capacity, int floor) {
+    couplingcell* cells = calloc(capacity, sizeof(couplingcell));
+    size_t i;
+
+    if (cells == NULL) {
+        return -1;
+    }
+
+    m->num_cells = 0;
+    for (i = 0; i < m->cells_capacity; i++) {
+        if (m->cells[i].key != 0
+            && m->cells[i].num_commits + m->cells[i].missed > floor) {
+            *find_cell(cells, capacity, m->cells[i].key) = m->cells[i];
+            m->num_cells = m->num_cells + 1;
+        }
+    }
+
+    free(m->cells);
+    m->cells = cells;
+    m->cells_capacity = capacity;
+    return 0;
+}
+
+static int add_cell(couplingmatrix* m, int first, int second) {
+    uint64_t key = ((uint64_t)(first + 1) << 32) | (uint64_t)(second + 1);
+    couplingcell* cell;
+
+    if (m->cells_capacity > 0
+        && (cell = find_cell(m->cells, m->cells_capacity, key))->key
+            == key) {
+        cell->num_commits = cell->num_commits + 1;
+        return 0;
+    }
+
+    /* a new pair, the rarest ones make room for it,
+     * half of the budget is freed at once */
+    if (m->num_cells >= m->budget) {
+        while (m->num_cells > m->budget / 2) {
+            m->pruned = m->pruned + 1;
+            if (rehash(m, m->cells_capacity, m->pruned) < 0) {
+                return -1;
+            }
+        }
+    }
+    if (4 * (m->num_cells + 1) > 3 * m->cells_capacity
+        && rehash(m, m->cells_capacity == 0 ? 64 : 2 * m->cells_capacity, 0)
+            < 0) {
+        return -1;
+    }
+
+    cell = find_cell(m->cells, m->cells_capacity, key);
+    cell->key = key;
+    cell->num_commits = 1;
+    cell->missed = m->pruned;
+    m->num_cells = m->num_cells + 1;
+    return 0;
+}
+
+static int compare_index(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* adds a commit that changed the given names, indices has room for
+ * num_names of them */
+static int add_commit(couplingmatrix* m, const char** names,
+    const size_t* lengths, size_t num_names, int* indices) {
+    size_t size = 0;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < num_names; i++) {
+        if ((indices[i] = add_node(m, names[i], lengths[i])) < 0) {
+            return -1;
+        }
+    }
+
+    /* a name counts once per commit */
+    qsort(indices, num_names, sizeof(int), compare_index);
+    for (i = 0; i < num_names; i++) {
+        if (size == 0 || indices[size - 1] != indices[i]) {
+            indices[size] = indices[i];
+            size = size + 1;
+        }
+    }
+
+    for (i = 0; i < size; i++) {
+        m->nodes[indices[i]].num_commits
+            = m->nodes[indices[i]].num_commits + 1;
+    }
+    if (size > COUPLING_FANOUT) {
+        return 0;
+    }
+
+    for (i = 0; i < size; i++) {
+        for (j = i + 1; j < size; j++) {
+            if (add_cell(m, indices[i], indices[j]) < 0) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void matrix_init(couplingmatrix* m) {
+    memset(m, 0, sizeof(couplingmatrix));
+    m->budget = COUPLING_BUDGET;
+    arena_init(&m->names);
+}
+
+static void matrix_destroy(couplingmatrix* m) {
+    free(m->nodes);
+    free(m->slots);
+    free(m->cells);
+    arena_destroy(&m->names);
+    memset(m, 0, sizeof(couplingmatrix));
+}
+
+void coupling_init(coupling* c) {
+    matrix_init(&c->files);
+    matrix_init(&c->dirs);
+}
+
+/* adds the files changed by a diff, and their directories, a file that
+ * was moved counts by its new path */
+int coupling_add(coupling* c, const editscript* script) {
+    size_t n = script->num_files;
+    const char** names;
+    size_t* lengths;
+    int* indices;
+    const char* slash;
+    size_t i;
+    int error = -1;
+
+    if (n == 0) {
+        return 0;
+    }
+
+    names = (const char**)malloc(n * sizeof(const char*));
+    lengths = (size_t*)malloc(n * sizeof(size_t));
+    indices = (int*)malloc(n * sizeof(int));
+    if (names == NULL || lengths == NULL || indices == NULL) {
+        goto cleanup;
+    }
+
+    for (i = 0; i < n; i++) {
+        const filechange* file = &script->files[i];
+        names[i] = script->paths
+            + (file->new_path >= 0 ? file->new_path : file->old_path);
+        lengths[i] = strlen(names[i]);
+    }
+    if (add_commit(&c->files, names, lengths, n, indices) < 0) {
+        goto cleanup;
+    }
+
+    /* files at the top level are in "." */
+    for (i = 0; i < n; i++) {
+        if ((slash = strrchr(names[i], '/')) == NULL) {
+            names[i] = ".";
+            lengths[i] = 1;
+        } else {
+            lengths[i] = (size_t)(slash - names[i]);
+        }
+    }
+    error = add_commit(&c->dirs, names, lengths, n, indices);
+
+cleanup:
+    free(names);
+    free(lengths);
+    free(indices);
+    return error;
+}
+
+/* orders by the number of commits, then by name */
+static bool before(const coupledpair* a, const coupledpair* b) {
+    int order;
+
+    if (a->num_commits != b->num_commits) {
+        return a->num_commits > b->num_commits;
+    }
+    if ((order = strcmp(a->first, b->first)) != 0) {
+        return order < 0;
+    }
+    return strcmp(a->second, b->second) < 0;
+}
+
+/* keeps the n pairs changed together most often in out, in order */
+static size_t top_pairs(
+    coupledpair* out, const couplingmatrix* m, size_t n, bool directories) {
+    size_t size = 0;
+    size_t i;
+    size_t j;
+
+    for (i = 0; n > 0 && i < m->cells_capacity; i++) {
+        const couplingcell* cell = &m->cells[i];
+        const couplingnode* a;
+        const couplingnode* b;
+        coupledpair pair;
+
+        if (cell->key == 0) {
+            continue;
+        }
+
+        a = &m->nodes[(cell->key >> 32) - 1];
+        b = &m->nodes[(cell->key & 0xffffffffULL) - 1];
+        if (strcmp(a->name, b->name) > 0) {
+            const couplingnode* t = a;
+            a = b;
+            b = t;
+        }
+        pair.directories = directories;
+        pair.first = a->name;
+        pair.second = b->name;
+        pair.num_commits = cell->num_commits;
+        pair.first_commits = a->num_commits;
+        pair.second_commits = b->num_commits;
+
+        if (size == n && !before(&pair, &out[n - 1])) {
+            continue;
+        }
+        if (size < n) {
+            size = size + 1;
+        }
+        for (j = size - 1; j > 0 && before(&pair, &out[j - 1]); j--) {
+            out[j] = out[j - 1];
+        }
+        out[j] = pair;
+    }
+
+    return size;
+}
+
+/* the n pairs of files changed together most often, followed by the n
+ * pairs of directories, the names are owned by c */
+int coupling_top(
+    coupledpair** out, size_t* num_pairs, const coupling* c, size_t n) {
+    coupledpair* pairs
+        = (coupledpair*)malloc((2 * n + 1) * sizeof(coupledpair));
+    size_t size;
+
+    *out = NULL;
+    *num_pairs = 0;
+    if (pairs == NULL) {
+        return -1;
+    }
+
+    size = top_pairs(pairs, &c->files, n, false);
+    size = size + top_pairs(pairs + size, &c->dirs, n, true);
+
+    *out = pairs;
+    *num_pairs = size;
+    return 0;
+}
+
+void coupling_destroy(coupling* c) {
+    matrix_destroy(&c->files);
+    matrix_destroy(&c->dirs);
+}
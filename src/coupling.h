@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#ifndef COUPLING_H_ /* Include guard */
+#define COUPLING_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "utils.h"
+#include "arena.h"
+#include "survival.h"
+
+/* commits that change more files do not add pairs, only to the number
+ * of commits of each file, since bulk changes say little about coupling
+ * and would add a quadratic number of pairs */
+#define COUPLING_FANOUT 32
+
+/* pairs kept per matrix before rare ones are pruned */
+#define COUPLING_BUDGET 65536
+
+/* pairs reported per interval, of files and of directories each */
+#define COUPLING_TOP 10
+
+/* a file or directory that was changed in the interval */
+typedef struct {
+    const char* name;
+    int num_commits;
+} couplingnode;
+
+typedef struct {
+    uint64_t hash;
+    int index; /* into nodes, -1 if the slot is free */
+} couplingslot;
+
+typedef struct {
+    uint64_t key; /* both node indices + 1, the smaller one first, 0 if free */
+    int num_commits;
+    int missed; /* commits that may have been pruned before it was added */
+} couplingcell;
+
+/*
+ * Sparse symmetric matrix of the number of commits that changed two
+ * nodes together. Names are hashed into an open addressing table like
+ * the authors of an interval, and so are the pairs of node indices. If
+ * there are more than budget pairs, the ones that were changed together
+ * least often are pruned, as in lossy counting: each round raises the
+ * level, and a pair is pruned if its count plus the commits it may have
+ * missed before it was added last is not above it. Counts are lower
+ * bounds, which are at most the level at the time of adding too small.
+ */
+typedef struct {
+    couplingnode* nodes;
+    size_t size;
+    size_t capacity;
+    couplingslot* slots;
+    size_t num_slots;
+    couplingcell* cells;
+    size_t num_cells;
+    size_t cells_capacity;
+    size_t budget;
+    int pruned; /* the level of the last pruning round */
+    arena names;
+} couplingmatrix;
+
+/* the files and the directories changed together in an interval */
+typedef struct {
+    couplingmatrix files;
+    couplingmatrix dirs;
+} coupling;
+
+typedef struct {
+    bool directories;
+    const char* first;
+    const char* second;
+    int num_commits;   /* that changed both */
+    int first_commits; /* that changed the first one */
+    int second_commits;
+} coupledpair;
+
+void coupling_init(coupling* c);
+
+int coupling_add(coupling* c, const editscript* script);
+
+int coupling_top(
+    coupledpair** out, size_t* num_pairs, const coupling* c, size_t n);
+
+void coupling_destroy(coupling* c);
+
+#endif
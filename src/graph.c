@@ -0,0 +1,680 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#include "graph.h"
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t num_commits;
+    uint64_t num_edges;
+    uint64_t num_names;
+    uint64_t names_size;
+} graph_header;
+
+/* git's commit-graph format, all integers are big-endian */
+#define GIT_GRAPH_SIGNATURE "CGPH"
+#define GIT_NO_PARENT 0x70000000
+#define GIT_EXTRA_EDGES 0x80000000
+#define GIT_LAST_EDGE 0x80000000
+#define CHUNK_OIDF 0x4f494446
+#define CHUNK_OIDL 0x4f49444c
+#define CHUNK_CDAT 0x43444154
+#define CHUNK_EDGE 0x45444745
+#define CDAT_SIZE (GIT_OID_RAWSZ + 16)
+
+static uint32_t get32(const unsigned char* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8
+        | (uint32_t)p[3];
+}
+
+static uint64_t get64(const unsigned char* p) {
+    return (uint64_t)get32(p) << 32 | get32(p + 4);
+}
+
+static unsigned char* read_file(const char* path, size_t* size) {
+    unsigned char* data;
+    FILE* fp;
+    long length;
+
+    if ((fp = fopen(path, "rb")) == NULL) {
+        return NULL;
+    }
+
+    if (fseek(fp, 0, SEEK_END) != 0 || (length = ftell(fp)) < 0
+        || fseek(fp, 0, SEEK_SET) != 0
+        || (data = (unsigned char*)malloc(length + 1)) == NULL) {
+        fclose(fp);
+        return NULL;
+    }
+
+    if (fread(data, 1, length, fp) != (size_t)length) {
+        free(data);
+        fclose(fp);
+        return NULL;
+    }
+
+    fclose(fp);
+    *size = length;
+    return data;
+}
+
+static void clear_file(graph* g) {
+    free(g->commits);
+    free(g->records);
+    free(g->edges);
+    free(g->names);
+    free(g->name_data);
+    g->commits = NULL;
+    g->records = NULL;
+    g->edges = NULL;
+    g->names = NULL;
+    g->name_data = NULL;
+    g->num_commits = 0;
+    g->num_edges = 0;
+    g->num_names = 0;
+    memset(g->fanout, 0, sizeof(g->fanout));
+}
+
+static int alloc_file(graph* g, size_t num_commits, size_t num_edges) {
+    g->commits = (git_oid*)malloc((num_commits + 1) * sizeof(git_oid));
+    g->records
+        = (graph_record*)malloc((num_commits + 1) * sizeof(graph_record));
+    g->edges = (git_oid*)malloc((num_edges + 1) * sizeof(git_oid));
+    if (g->commits == NULL || g->records == NULL || g->edges == NULL) {
+        return -1;
+    }
+    g->num_commits = num_commits;
+    g->num_edges = num_edges;
+    return 0;
+}
+
+static size_t add_parent(uint32_t* out, size_t n, uint32_t parent) {
+    if (out != NULL) {
+        out[n] = parent;
+    }
+    return n + 1;
+}
+
+/* the parents of a commit in git's commit-graph, in order,
+ * only counts them if out is NULL */
+static size_t git_parents(uint32_t* out, const unsigned char* cdat,
+    const unsigned char* edge, size_t edge_size) {
+    uint32_t p1 = get32(cdat + GIT_OID_RAWSZ);
+    uint32_t p2 = get32(cdat + GIT_OID_RAWSZ + 4);
+    size_t n = 0;
+    size_t i;
+
+    if (p1 != GIT_NO_PARENT) {
+        n = add_parent(out, n, p1);
+    }
+    if (p2 == GIT_NO_PARENT) {
+        return n;
+    }
+    if ((p2 & GIT_EXTRA_EDGES) == 0) {
+        return add_parent(out, n, p2);
+    }
+
+    for (i = (size_t)(p2 & ~GIT_EXTRA_EDGES) * 4; i + 4 <= edge_size;
+         i = i + 4) {
+        uint32_t e = get32(edge + i);
+        n = add_parent(out, n, e & ~GIT_LAST_EDGE);
+        if (e & GIT_LAST_EDGE) {
+            break;
+        }
+    }
+    return n;
+}
+
+/* a missing or unsupported file is not an error, it is just not used,
+ * split graphs (commit-graph chains) are not supported */
+static int read_git_graph(graph* g, const char* path) {
+    const unsigned char* oidf = NULL;
+    const unsigned char* oidl = NULL;
+    const unsigned char* cdat = NULL;
+    const unsigned char* edge = NULL;
+    size_t edge_size = 0;
+    size_t num_edges = 0;
+    unsigned char* data;
+    size_t size = 0;
+    size_t num_chunks;
+    size_t n;
+    size_t i;
+    size_t j;
+
+    if ((data = read_file(path, &size)) == NULL) {
+        return 0;
+    }
+
+    /* signature, version 1, SHA-1, number of chunks, no base graphs */
+    if (size < 8 || memcmp(data, GIT_GRAPH_SIGNATURE, 4) || data[4] != 1
+        || data[5] != 1 || data[7] != 0
+        || size < 8 + ((size_t)data[6] + 1) * 12) {
+        free(data);
+        return 0;
+    }
+
+    num_chunks = data[6];
+    for (i = 0; i < num_chunks; i++) {
+        const unsigned char* entry = data + 8 + i * 12;
+        uint64_t start = get64(entry + 4);
+        uint64_t end = get64(entry + 16);
+        if (start > end || end > size) {
+            free(data);
+            return 0;
+        }
+        switch (get32(entry)) {
+        case CHUNK_OIDF:
+            oidf = end - start == 1024 ? data + start : NULL;
+            break;
+        case CHUNK_OIDL:
+            oidl = data + start;
+            break;
+        case CHUNK_CDAT:
+            cdat = data + start;
+            break;
+        case CHUNK_EDGE:
+            edge = data + start;
+            edge_size = end - start;
+            break;
+        }
+    }
+
+    if (oidf == NULL || oidl == NULL || cdat == NULL
+        || (n = get32(oidf + 255 * 4)) * CDAT_SIZE
+            > size - (size_t)(cdat - data)
+        || n * GIT_OID_RAWSZ > size - (size_t)(oidl - data)) {
+        free(data);
+        return 0;
+    }
+
+    for (i = 0; i < n; i++) {
+        num_edges = num_edges
+            + git_parents(NULL, cdat + i * CDAT_SIZE, edge, edge_size);
+    }
+
+    if (alloc_file(g, n, num_edges) < 0) {
+        clear_file(g);
+        free(data);
+        return -1;
+    }
+
+    for (i = 0; i < 256; i++) {
+        g->fanout[i] = get32(oidf + i * 4);
+    }
+
+    num_edges = 0;
+    for (i = 0; i < n; i++) {
+        const unsigned char* c = cdat + i * CDAT_SIZE;
+        graph_record* r = &g->records[i];
+        uint32_t parents[git_parents(NULL, c, edge, edge_size) + 1];
+        size_t num_parents = git_parents(parents, c, edge, edge_size);
+
+        git_oid_fromraw(&g->commits[i], oidl + i * GIT_OID_RAWSZ);
+        memset(r, 0, sizeof(graph_record));
+        git_oid_fromraw(&r->tree, c);
+        /* the upper 30 bits hold the generation number */
+        r->time = (int64_t)((uint64_t)(get32(c + GIT_OID_RAWSZ + 8) & 3) << 32
+            | get32(c + GIT_OID_RAWSZ + 12));
+        r->author = NO_AUTHOR;
+        r->parents = num_edges;
+        r->num_parents = num_parents;
+
+        for (j = 0; j < num_parents; j++) {
+            if (parents[j] >= n) {
+                clear_file(g);
+                free(data);
+                return 0;
+            }
+            git_oid_fromraw(&g->edges[num_edges],
+                oidl + (size_t)parents[j] * GIT_OID_RAWSZ);
+            num_edges = num_edges + 1;
+        }
+    }
+
+    free(data);
+    return 0;
+}
+
+static int read_cache(graph* g, const char* path) {
+    graph_header header;
+    unsigned char* data;
+    unsigned char* p;
+    size_t size = 0;
+    size_t expected;
+    size_t i;
+    size_t n;
+
+    if ((data = read_file(path, &size)) == NULL) {
+        return 0;
+    }
+
+    if (size < sizeof(header)) {
+        free(data);
+        return 0;
+    }
+    memcpy(&header, data, sizeof(header));
+    n = header.num_commits;
+    expected = sizeof(header) + sizeof(g->fanout)
+        + n * (sizeof(git_oid) + sizeof(graph_record))
+        + header.num_edges * sizeof(git_oid) + header.names_size;
+
+    if (memcmp(header.magic, GRAPH_MAGIC, sizeof(GRAPH_MAGIC))
+        || header.version != GRAPH_VERSION || size != expected
+        || (header.names_size > 0 && data[size - 1] != '\0')) {
+        free(data);
+        return 0;
+    }
+
+    if (alloc_file(g, n, header.num_edges) < 0
+        || (g->name_data = (char*)malloc(header.names_size + 1)) == NULL
+        || (g->names = (char**)malloc((header.num_names + 1) * sizeof(char*)))
+            == NULL) {
+        clear_file(g);
+        free(data);
+        return -1;
+    }
+
+    p = data + sizeof(header);
+    memcpy(g->fanout, p, sizeof(g->fanout));
+    p = p + sizeof(g->fanout);
+    memcpy(g->commits, p, n * sizeof(git_oid));
+    p = p + n * sizeof(git_oid);
+    memcpy(g->records, p, n * sizeof(graph_record));
+    p = p + n * sizeof(graph_record);
+    memcpy(g->edges, p, header.num_edges * sizeof(git_oid));
+    p = p + header.num_edges * sizeof(git_oid);
+    memcpy(g->name_data, p, header.names_size);
+    free(data);
+
+    for (i = 0; i < header.names_size && g->num_names < header.num_names;
+         i = i + strlen(g->name_data + i) + 1) {
+        g->names[g->num_names] = g->name_data + i;
+        g->num_names = g->num_names + 1;
+    }
+
+    for (i = 0; i < n; i++) {
+        const graph_record* r = &g->records[i];
+        if ((r->author != NO_AUTHOR && r->author >= g->num_names)
+            || (uint64_t)r->parents + r->num_parents > g->num_edges) {
+            clear_file(g);
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+graph* graph_open(git_repository* repo, bool cache) {
+    const char* gitdir = git_repository_path(repo);
+    char path[strlen(gitdir) + sizeof(GIT_GRAPH_FILE)];
+    graph* g = (graph*)calloc(1, sizeof(graph));
+
+    if (g == NULL) {
+        return NULL;
+    }
+
+    arena_init(&g->data);
+    if ((g->nodes = oidmap_create()) == NULL) {
+        free(g);
+        return NULL;
+    }
+
+    if (cache) {
+        g->cache_path = (char*)malloc(strlen(gitdir) + sizeof(GRAPH_FILE));
+        if (g->cache_path == NULL) {
+            graph_destroy(g);
+            return NULL;
+        }
+        strcpy(g->cache_path, gitdir);
+        strcat(g->cache_path, GRAPH_FILE);
+        if (read_cache(g, g->cache_path) < 0) {
+            graph_destroy(g);
+            return NULL;
+        }
+    }
+
+    if (g->num_commits == 0) {
+        strcpy(path, gitdir);
+        strcat(path, GIT_GRAPH_FILE);
+        if (read_git_graph(g, path) < 0) {
+            graph_destroy(g);
+            return NULL;
+        }
+    }
+
+    return g;
+}
+
+/* index of the commit in the file, or -1 */
+static long find(const graph* g, const git_oid* commit) {
+    size_t lo = commit->id[0] == 0 ? 0 : g->fanout[commit->id[0] - 1];
+    size_t hi = g->fanout[commit->id[0]];
+
+    if (hi > g->num_commits) {
+        return -1;
+    }
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = git_oid_cmp(&g->commits[mid], commit);
+        if (cmp == 0) {
+            return (long)mid;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return -1;
+}
+
+static int parse(
+    graph_node** out, graph* g, git_repository* repo, const git_oid* id) {
+    git_commit* commit;
+    graph_node* node;
+    unsigned int i;
+    int error;
+
+    if ((error = git_commit_lookup(&commit, repo, id)) < 0) {
+        return error;
+    }
+
+    node = (graph_node*)arena_alloc(&g->data, sizeof(graph_node));
+    if (node != NULL) {
+        node->tree = *git_commit_tree_id(commit);
+        node->time = git_commit_time(commit);
+        node->author = arena_strdup(&g->data, git_commit_author(commit)->name);
+        node->num_parents = git_commit_parentcount(commit);
+        node->parents = (git_oid*)arena_alloc(
+            &g->data, (node->num_parents + 1) * sizeof(git_oid));
+    }
+    if (node == NULL || node->author == NULL || node->parents == NULL
+        || oidmap_set(g->nodes, id, node) < 0) {
+        git_commit_free(commit);
+        return -1;
+    }
+
+    for (i = 0; i < node->num_parents; i++) {
+        node->parents[i] = *git_commit_parent_id(commit, i);
+    }
+    git_commit_free(commit);
+
+    g->parsed = g->parsed + 1;
+    g->dirty = g->cache_path != NULL;
+    *out = node;
+    return 0;
+}
+
+/* the commit is only parsed if it is not in the graph, or if its author
+ * is needed and not known */
+int graph_lookup(commitinfo* out, graph* g, git_repository* repo,
+    const git_oid* commit, bool author) {
+    graph_node* node;
+    void* value;
+    long i;
+    int error;
+
+    if (oidmap_get(g->nodes, commit, &value)) {
+        node = (graph_node*)value;
+    } else if ((i = find(g, commit)) >= 0
+        && (!author || g->records[i].author != NO_AUTHOR)) {
+        const graph_record* r = &g->records[i];
+        out->tree = r->tree;
+        out->time = r->time;
+        out->author = r->author == NO_AUTHOR ? NULL : g->names[r->author];
+        out->num_parents = r->num_parents;
+        out->parents = &g->edges[r->parents];
+        return 0;
+    } else if ((error = parse(&node, g, repo, commit)) < 0) {
+        return error;
+    }
+
+    out->tree = node->tree;
+    out->time = node->time;
+    out->author = node->author;
+    out->num_parents = node->num_parents;
+    out->parents = node->parents;
+    return 0;
+}
+
+typedef struct {
+    git_oid id;
+    const graph_record* record;
+    const graph_node* node;
+    uint32_t author;
+} save_entry;
+
+static int compare_entries(const void* a, const void* b) {
+    const save_entry* x = (const save_entry*)a;
+    const save_entry* y = (const save_entry*)b;
+    return git_oid_cmp(&x->id, &y->id);
+}
+
+/* assigns every distinct author name an index, in order of appearance */
+static int intern_authors(save_entry* entries, size_t num_entries,
+    const graph* g, const char*** out, size_t* num_names, size_t* size) {
+    size_t capacity = 64;
+    uint32_t* slots;
+    const char** names;
+    size_t i;
+
+    while (capacity < 2 * num_entries) {
+        capacity = 2 * capacity;
+    }
+    slots = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    names = (const char**)malloc((num_entries + 1) * sizeof(char*));
+    if (slots == NULL || names == NULL) {
+        free(slots);
+        free(names);
+        return -1;
+    }
+    memset(slots, 0xff, capacity * sizeof(uint32_t));
+
+    *num_names = 0;
+    *size = 0;
+    for (i = 0; i < num_entries; i++) {
+        const char* name = entries[i].node != NULL
+            ? entries[i].node->author
+            : entries[i].record->author == NO_AUTHOR
+                ? NULL
+                : g->names[entries[i].record->author];
+        size_t slot;
+
+        entries[i].author = NO_AUTHOR;
+        if (name == NULL) {
+            continue;
+        }
+
+        slot = hash_string(name, strlen(name)) & (capacity - 1);
+        while (slots[slot] != NO_AUTHOR && strcmp(names[slots[slot]], name)) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (slots[slot] == NO_AUTHOR) {
+            slots[slot] = *num_names;
+            names[*num_names] = name;
+            *num_names = *num_names + 1;
+            *size = *size + strlen(name) + 1;
+        }
+        entries[i].author = slots[slot];
+    }
+
+    free(slots);
+    *out = names;
+    return 0;
+}
+
+/* the parsed commits are merged with the file, which is then replaced */
+int graph_save(graph* g) {
+    size_t num_entries = 0;
+    save_entry* entries;
+    const char** names = NULL;
+    size_t num_names = 0;
+    size_t names_size = 0;
+    size_t num_edges = 0;
+    size_t iter = 0;
+    size_t i;
+    graph_header header;
+    uint32_t fanout[256];
+    git_oid id;
+    void* value;
+    FILE* fp;
+    int error = 0;
+
+    if (g->cache_path == NULL || !g->dirty) {
+        return 0;
+    }
+
+    entries = (save_entry*)malloc(
+        (g->num_commits + oidmap_size(g->nodes) + 1) * sizeof(save_entry));
+    if (entries == NULL) {
+        return -1;
+    }
+
+    while (oidmap_next(g->nodes, &iter, &id, &value)) {
+        entries[num_entries].id = id;
+        entries[num_entries].record = NULL;
+        entries[num_entries].node = (const graph_node*)value;
+        num_entries = num_entries + 1;
+    }
+    for (i = 0; i < g->num_commits; i++) {
+        if (!oidmap_get(g->nodes, &g->commits[i], &value)) {
+            entries[num_entries].id = g->commits[i];
+            entries[num_entries].record = &g->records[i];
+            entries[num_entries].node = NULL;
+            num_entries = num_entries + 1;
+        }
+    }
+    qsort(entries, num_entries, sizeof(save_entry), compare_entries);
+
+    if (intern_authors(
+            entries, num_entries, g, &names, &num_names, &names_size)
+        < 0) {
+        free(entries);
+        return -1;
+    }
+
+    memset(fanout, 0, sizeof(fanout));
+    for (i = 0; i < num_entries; i++) {
+        fanout[entries[i].id.id[0]] = fanout[entries[i].id.id[0]] + 1;
+        num_edges = num_edges
+            + (entries[i].node != NULL ? entries[i].node->num_parents
+                                       : entries[i].record->num_parents);
+    }
+    for (i = 1; i < 256; i++) {
+        fanout[i] = fanout[i] + fanout[i - 1];
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GRAPH_MAGIC, sizeof(GRAPH_MAGIC));
+    header.version = GRAPH_VERSION;
+    header.num_commits = num_entries;
+    header.num_edges = num_edges;
+    header.num_names = num_names;
+    header.names_size = names_size;
+
+    char tmp[strlen(g->cache_path) + 5];
+    strcpy(tmp, g->cache_path);
+    strcat(tmp, ".tmp");
+
+    if ((fp = fopen(tmp, "wb")) == NULL) {
+        free(names);
+        free(entries);
+        return -1;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1
+        || fwrite(fanout, sizeof(fanout), 1, fp) != 1) {
+        error = -1;
+    }
+    for (i = 0; error == 0 && i < num_entries; i++) {
+        if (fwrite(&entries[i].id, sizeof(git_oid), 1, fp) != 1) {
+            error = -1;
+        }
+    }
+
+    num_edges = 0;
+    for (i = 0; error == 0 && i < num_entries; i++) {
+        graph_record r;
+        memset(&r, 0, sizeof(r));
+        if (entries[i].node != NULL) {
+            r.tree = entries[i].node->tree;
+            r.time = entries[i].node->time;
+            r.num_parents = entries[i].node->num_parents;
+        } else {
+            r.tree = entries[i].record->tree;
+            r.time = entries[i].record->time;
+            r.num_parents = entries[i].record->num_parents;
+        }
+        r.author = entries[i].author;
+        r.parents = num_edges;
+        num_edges = num_edges + r.num_parents;
+        if (fwrite(&r, sizeof(r), 1, fp) != 1) {
+            error = -1;
+        }
+    }
+
+    for (i = 0; error == 0 && i < num_entries; i++) {
+        const git_oid* parents = entries[i].node != NULL
+            ? entries[i].node->parents
+            : &g->edges[entries[i].record->parents];
+        size_t n = entries[i].node != NULL ? entries[i].node->num_parents
+                                           : entries[i].record->num_parents;
+        if (n > 0 && fwrite(parents, sizeof(git_oid), n, fp) != n) {
+            error = -1;
+        }
+    }
+
+    for (i = 0; error == 0 && i < num_names; i++) {
+        if (fwrite(names[i], strlen(names[i]) + 1, 1, fp) != 1) {
+            error = -1;
+        }
+    }
+
+    free(names);
+    free(entries);
+
+    if (fflush(fp) != 0) {
+        error = -1;
+    }
+    if (fclose(fp) != 0 || error < 0 || rename(tmp, g->cache_path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+
+    g->dirty = false;
+    return 0;
+}
+
+void graph_destroy(graph* g) {
+    clear_file(g);
+    if (g->nodes != NULL) {
+        oidmap_destroy(g->nodes);
+    }
+    arena_destroy(&g->data);
+    free(g->cache_path);
+    free(g);
+}
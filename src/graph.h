@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#ifndef GRAPH_H_ /* Include guard */
+#define GRAPH_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <git2.h>
+#include "utils.h"
+#include "arena.h"
+#include "oidmap.h"
+
+/*
+ * Commit graph: parents, commit time, root tree and author of commits,
+ * without inflating and parsing the commit objects.
+ *
+ * The graph is read from churny's own graph cache in the git directory
+ * if it is enabled and present, otherwise from git's commit-graph file
+ * (objects/info/commit-graph), which has everything but the authors.
+ * Commits that are not in the file, or whose author is needed but not
+ * known, are parsed once and kept in memory. With the cache enabled,
+ * they are saved to it when the graph is destroyed, so the next run
+ * does not parse any commit it has seen before.
+ */
+#define GRAPH_FILE "churny-graph"
+#define GRAPH_MAGIC "CHURNYG"
+#define GRAPH_VERSION 1
+#define GIT_GRAPH_FILE "objects/info/commit-graph"
+
+/* commits of git's commit-graph have no author */
+#define NO_AUTHOR UINT32_MAX
+
+typedef struct {
+    git_oid tree;
+    int64_t time;
+    uint32_t author;      /* index into names, or NO_AUTHOR */
+    uint32_t parents;     /* index of the first parent in edges */
+    uint32_t num_parents;
+    uint32_t reserved;
+} graph_record;
+
+/* a commit that was parsed during this run */
+typedef struct {
+    git_oid tree;
+    git_time_t time;
+    char* author;
+    unsigned int num_parents;
+    git_oid* parents;
+} graph_node;
+
+typedef struct {
+    /* the file, commits are sorted by id */
+    uint32_t fanout[256];
+    size_t num_commits;
+    git_oid* commits;
+    graph_record* records;
+    size_t num_edges;
+    git_oid* edges;
+    size_t num_names;
+    char** names;
+    char* name_data;
+    /* parsed commits */
+    oidmap* nodes;
+    arena data;
+    char* cache_path; /* NULL if the graph cache is disabled */
+    bool dirty;
+    unsigned long parsed;
+} graph;
+
+/* valid as long as the graph */
+typedef struct {
+    git_oid tree;
+    git_time_t time;
+    const char* author;
+    unsigned int num_parents;
+    const git_oid* parents;
+} commitinfo;
+
+graph* graph_open(git_repository* repo, bool cache);
+
+int graph_lookup(commitinfo* out, graph* g, git_repository* repo,
+    const git_oid* commit, bool author);
+
+int graph_save(graph* g);
+
+void graph_destroy(graph* g);
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#include "hll.h"
+
+static const char digits[]
+    = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+void hll_init(hll* sketch) { memset(sketch, 0, sizeof(hll)); }
+
+void hll_add(hll* sketch, const char* name) {
+    uint64_t h = hash_string(name, strlen(name));
+    size_t index = h >> (64 - HLL_PRECISION);
+    uint64_t rest = h << HLL_PRECISION;
+    uint8_t rank = 1;
+
+    /* position of the first set bit in the remaining bits */
+    while (rank <= 64 - HLL_PRECISION && (rest & (1ULL << 63)) == 0) {
+        rest = rest << 1;
+        rank = rank + 1;
+    }
+
+    if (rank > sketch->registers[index]) {
+        sketch->registers[index] = rank;
+    }
+}
+
+void hll_merge(hll* dst, const hll* src) {
+    size_t i;
+
+    for (i = 0; i < HLL_REGISTERS; i++) {
+        if (src->registers[i] > dst->registers[i]) {
+            dst->registers[i] = src->registers[i];
+        }
+    }
+}
+
+double hll_count(const hll* sketch) {
+    const double m = HLL_REGISTERS;
+    double alpha = 0.7213 / (1.0 + 1.079 / m);
+    double sum = 0.0;
+    double e;
+    size_t zeros = 0;
+    size_t i;
+
+    for (i = 0; i < HLL_REGISTERS; i++) {
+        sum = sum + ldexp(1.0, -sketch->registers[i]);
+        if (sketch->registers[i] == 0) {
+            zeros = zeros + 1;
+        }
+    }
+
+    e = alpha * m * m / sum;
+
+    /* small cardinalities are counted more precisely by linear counting,
+     * the 64 bit hash makes a large range correction unnecessary */
+    if (e <= 2.5 * m && zeros > 0) {
+        e = m * log(m / (double)zeros);
+    }
+    return e;
+}
+
+void hll_encode(char* out, const hll* sketch) {
+    size_t length = sizeof(HLL_PREFIX) - 1;
+    size_t i;
+
+    memcpy(out, HLL_PREFIX, length);
+    for (i = 0; i < HLL_REGISTERS; i++) {
+        out[length + i] = digits[sketch->registers[i]];
+    }
+    out[HLL_ENCODED_LENGTH] = '\0';
+}
+
+int hll_decode(hll* sketch, const char* s) {
+    size_t length = sizeof(HLL_PREFIX) - 1;
+    size_t i;
+
+    if (strncmp(s, HLL_PREFIX, length) != 0) {
+        return -1;
+    }
+
+    s = s + length;
+    for (i = 0; i < HLL_REGISTERS; i++) {
+        const char* digit = s[i] == '\0' ? NULL : strchr(digits, s[i]);
+        if (digit == NULL || digit - digits > 64 - HLL_PRECISION + 1) {
+            return -1;
+        }
+        sketch->registers[i] = (uint8_t)(digit - digits);
+    }
+
+    return 0;
+}
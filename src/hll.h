@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#ifndef HLL_H_ /* Include guard */
+#define HLL_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "utils.h"
+
+/*
+ * HyperLogLog sketch of a set of author names.
+ *
+ * A sketch estimates the number of distinct authors with a standard
+ * error of 1.04 / sqrt(HLL_REGISTERS), about 3%, in a fixed amount of
+ * memory. The union of two sets is the register-wise maximum of their
+ * sketches, so monthly sketches can be merged into quarters, rolling
+ * windows or totals across repositories without keeping any names.
+ */
+#define HLL_PRECISION 10
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+
+/* a register holds at most 64 - HLL_PRECISION + 1, which fits in one
+ * base64 digit, encoded sketches are prefixed with the precision */
+#define HLL_PREFIX "hll10:"
+#define HLL_ENCODED_LENGTH (sizeof(HLL_PREFIX) - 1 + HLL_REGISTERS)
+
+typedef struct {
+    uint8_t registers[HLL_REGISTERS];
+} hll;
+
+void hll_init(hll* sketch);
+
+void hll_add(hll* sketch, const char* name);
+
+void hll_merge(hll* dst, const hll* src);
+
+double hll_count(const hll* sketch);
+
+/* out needs HLL_ENCODED_LENGTH + 1 bytes */
+void hll_encode(char* out, const hll* sketch);
+
+int hll_decode(hll* sketch, const char* s);
+
+#endif
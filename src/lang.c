@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#include "lang.h"
+
+static const char* names[NUM_LANGUAGES] = { "C", "C++", "C#", "Go", "Java",
+    "JavaScript", "TypeScript", "Python", "Ruby", "Rust", "PHP", "Shell",
+    "Kotlin", "Swift", "Scala", "Objective-C", "HTML", "CSS", "Markdown",
+    "Perl" };
+
+/* file extension -> index into names */
+static const struct {
+    const char* extension;
+    int language;
+} extensions[] = {
+    { ".c", 0 },
+    { ".h", 0 },
+    { ".cc", 1 },
+    { ".cpp", 1 },
+    { ".cxx", 1 },
+    { ".hh", 1 },
+    { ".hpp", 1 },
+    { ".hxx", 1 },
+    { ".cs", 2 },
+    { ".go", 3 },
+    { ".java", 4 },
+    { ".js", 5 },
+    { ".jsx", 5 },
+    { ".mjs", 5 },
+    { ".cjs", 5 },
+    { ".ts", 6 },
+    { ".tsx", 6 },
+    { ".py", 7 },
+    { ".rb", 8 },
+    { ".rs", 9 },
+    { ".php", 10 },
+    { ".sh", 11 },
+    { ".bash", 11 },
+    { ".kt", 12 },
+    { ".kts", 12 },
+    { ".swift", 13 },
+    { ".scala", 14 },
+    { ".m", 15 },
+    { ".mm", 15 },
+    { ".html", 16 },
+    { ".htm", 16 },
+    { ".css", 17 },
+    { ".md", 18 },
+    { ".pl", 19 },
+    { ".pm", 19 },
+};
+
+#define NUM_EXTENSIONS (sizeof(extensions) / sizeof(extensions[0]))
+
+const char* language_name(int language) {
+    return language >= 0 && language < NUM_LANGUAGES ? names[language] : "";
+}
+
+/* classifies a path by its extension, returns -1 for other files */
+int language_of(const char* path) {
+    const char* extension = strrchr(path, '.');
+    size_t i;
+
+    /* dots in directory names do not start an extension */
+    if (extension == NULL || strchr(extension, '/') != NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < NUM_EXTENSIONS; i++) {
+        if (!strcmp(extension, extensions[i].extension)) {
+            return extensions[i].language;
+        }
+    }
+
+    return -1;
+}
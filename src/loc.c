@@ -22,50 +22,6 @@
 
 #include "loc.h"
 
-int calculate_loc(
-    git_repository* repo, const git_oid* oid, const char* extension) {
-    const char id[] = "calculate_loc";
-
-    int loc = 0;
-    git_commit* commit;
-    git_object* gobject;
-
-    git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
-    opts.checkout_strategy = GIT_CHECKOUT_FORCE;
-
-    chdir(git_repository_workdir(repo));
-
-#if defined(DEBUG) || defined(TRACE)
-    char buf[GIT_OID_HEXSZ + 1];
-    git_oid_fmt(buf, oid);
-    buf[GIT_OID_HEXSZ] = '\0';
-    print_debug("%s %s - counting lines of commit %s: ", debug, id, buf);
-#endif
-
-    git_commit_lookup(&commit, repo, oid);
-    git_object_lookup(&gobject, repo, oid, GIT_OBJ_COMMIT);
-    git_checkout_tree(repo, gobject, &opts);
-
-    loc = calculate_loc_dir(NULL, extension);
-
-    git_object_free(gobject);
-    git_commit_free(commit);
-
-    /* checkout HEAD again */
-    git_checkout_head(repo, &opts);
-
-#if defined(DEBUG) || defined(TRACE)
-    print_debug("%d\n", loc);
-#endif
-
-    if (loc < 0) {
-        exit_error(EXIT_FAILURE, "%s %s - Error while "
-                                 "counting lines of code\n",
-            fatal, id);
-    }
-    return loc;
-}
-
 int calculate_loc_dir(const char* path, const char* extension) {
     const char id[] = "calculate_loc_dir";
 
@@ -113,10 +69,6 @@ int calculate_loc_dir(const char* path, const char* extension) {
 
     if (fgets(prbuf, sizeof(prbuf) - 1, fp) != NULL) {
         loc = atoi(prbuf);
-    } else {
-        exit_error(EXIT_FAILURE, "%s %s - Error while "
-                                 "counting lines of code\n",
-            fatal, id);
     }
 
     pclose(fp);
@@ -144,3 +96,152 @@ int calculate_loc_dir(const char* path, const char* extension) {
 #endif
     return loc;
 }
+
+/* counts non-blank lines like calculate_loc_dir(),
+ * files that are not plain ASCII count as 0 lines */
+int count_lines(const unsigned char* content, size_t size) {
+    size_t i;
+    bool blank = true;
+    int loc = 0;
+
+    for (i = 0; i < size; i++) {
+        if (content[i] == 0 || content[i] >= 0x80) {
+            return 0;
+        }
+    }
+
+    for (i = 0; i < size; i++) {
+        if (content[i] == '\n') {
+            loc = blank ? loc : loc + 1;
+            blank = true;
+        } else if (!isspace(content[i])) {
+            blank = false;
+        }
+    }
+
+    return blank ? loc : loc + 1;
+}
+
+int count_blob_lines(const git_blob* blob) {
+    return count_lines((const unsigned char*)git_blob_rawcontent(blob),
+        (size_t)git_blob_rawsize(blob));
+}
+
+typedef struct {
+    langfiles* list;
+    const char* extension; /* NULL to collect the files of all languages */
+} collector;
+
+static int collect_counted_file(
+    const char* root, const git_tree_entry* entry, void* payload) {
+    collector* c = (collector*)payload;
+    langfiles* list = c->list;
+    const char* name = git_tree_entry_name(entry);
+    int language = 0;
+
+    (void)root;
+
+    if (git_tree_entry_type(entry) != GIT_OBJ_BLOB
+        || git_tree_entry_filemode(entry) == GIT_FILEMODE_LINK) {
+        return 0;
+    }
+    if (c->extension == NULL && (language = language_of(name)) < 0) {
+        return 0;
+    }
+    if (c->extension != NULL
+        && (strlen(name) < strlen(c->extension)
+               || strcmp(name + strlen(name) - strlen(c->extension),
+                   c->extension))) {
+        return 0;
+    }
+
+    if (list->size == list->capacity) {
+        size_t capacity = list->capacity == 0 ? 256 : 2 * list->capacity;
+        langfile* files = realloc(list->files, capacity * sizeof(langfile));
+        if (files == NULL) {
+            return -1;
+        }
+        list->files = files;
+        list->capacity = capacity;
+    }
+
+    list->files[list->size].id = *git_tree_entry_id(entry);
+    list->files[list->size].language = language;
+    list->size = list->size + 1;
+    return 0;
+}
+
+/*
+ * Collects the files of a commit whose lines of code are counted, i.e.,
+ * the files with the extension (all files if it is empty), or with a
+ * NULL extension, the files that belong to one of the languages. The
+ * language of the files is 0 if an extension is given. Lines are counted
+ * from the object database, so no working directory is needed.
+ */
+int list_counted_files(langfiles* out, git_repository* repo,
+    const git_oid* commit, const char* extension) {
+    collector c = { out, extension };
+    git_commit* parsed = NULL;
+    git_tree* tree = NULL;
+    int error;
+
+    out->size = 0;
+    if ((error = git_commit_lookup(&parsed, repo, commit)) == 0
+        && (error = git_commit_tree(&tree, parsed)) == 0) {
+        error = git_tree_walk(
+            tree, GIT_TREEWALK_PRE, collect_counted_file, &c);
+    }
+
+    git_tree_free(tree);
+    git_commit_free(parsed);
+    return error < 0 ? -1 : 0;
+}
+
+/*
+ * Estimates the lines of code of a commit from a random sample of its
+ * files, which are read from the object database.
+ */
+int estimate_loc(estimate* out, git_repository* repo, const git_oid* oid,
+    const char* extension, size_t sample_size) {
+    langfiles list = { NULL, 0, 0 };
+    samplesum sum = { 0.0, 0.0 };
+    size_t* indices = NULL;
+    unsigned int seed;
+    size_t i;
+    int error;
+
+    if ((error = list_counted_files(&list, repo, oid, extension)) < 0) {
+        goto cleanup;
+    }
+
+    if (sample_size > list.size) {
+        sample_size = list.size;
+    }
+
+    indices = (size_t*)malloc((list.size + 1) * sizeof(size_t));
+    if (indices == NULL) {
+        error = -1;
+        goto cleanup;
+    }
+
+    /* the same commit always gets the same sample */
+    memcpy(&seed, oid->id, sizeof(seed));
+    sample_indices(indices, list.size, sample_size, &seed);
+
+    for (i = 0; i < sample_size; i++) {
+        git_blob* blob;
+        if ((error = git_blob_lookup(&blob, repo, &list.files[indices[i]].id))
+            < 0) {
+            goto cleanup;
+        }
+        sample_add(&sum, count_blob_lines(blob));
+        git_blob_free(blob);
+    }
+
+    *out = sample_estimate(&sum, list.size, sample_size);
+
+cleanup:
+    free(indices);
+    free(list.files);
+    return error < 0 ? -1 : 0;
+}
@@ -25,11 +25,34 @@
 
 #include <git2.h>
 #include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
 #include "utils.h"
+#include "sample.h"
+#include "lang.h"
 
-int calculate_loc(
-    git_repository* repo, const git_oid* oid, const char* extension);
+/* a file of a commit whose lines of code are counted */
+typedef struct {
+    git_oid id;
+    int language;
+} langfile;
+
+typedef struct {
+    langfile* files;
+    size_t size;
+    size_t capacity;
+} langfiles;
 
 int calculate_loc_dir(const char* path, const char* extension);
 
+int count_lines(const unsigned char* content, size_t size);
+
+int count_blob_lines(const git_blob* blob);
+
+int list_counted_files(langfiles* out, git_repository* repo,
+    const git_oid* commit, const char* extension);
+
+int estimate_loc(estimate* out, git_repository* repo, const git_oid* oid,
+    const char* extension, size_t sample_size);
+
 #endif
@@ -0,0 +1,672 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+
+ */
+
+#include <getopt.h>
+#include "churny.h"
+#include "server.h"
+
+/* options without a short form */
+#define OPT_CHECKPOINT 256
+#define OPT_CHECKPOINT_INTERVAL 257
+#define OPT_RESUME 258
+#define OPT_MERGE_SKETCHES 259
+#define OPT_CHANGED_PATHS 260
+#define OPT_GRAPH_CACHE 261
+#define OPT_AUTHOR_CHURN 262
+#define OPT_LANGUAGES 263
+#define OPT_TIMELINE 264
+#define OPT_DEADLINE 265
+#define OPT_PROGRESS 266
+#define OPT_STATUS_FILE 267
+#define OPT_PROGRESS_INTERVAL 268
+#define OPT_SURVIVAL 269
+#define OPT_COUPLING 270
+
+/* exit status if the deadline has passed, the output is incomplete */
+#define EXIT_PARTIAL 2
+
+static const struct option long_options[] = {
+    { "checkpoint", required_argument, NULL, OPT_CHECKPOINT },
+    { "checkpoint-interval", required_argument, NULL, OPT_CHECKPOINT_INTERVAL },
+    { "resume", no_argument, NULL, OPT_RESUME },
+    { "merge-sketches", no_argument, NULL, OPT_MERGE_SKETCHES },
+    { "changed-paths", no_argument, NULL, OPT_CHANGED_PATHS },
+    { "graph-cache", no_argument, NULL, OPT_GRAPH_CACHE },
+    { "author-churn", required_argument, NULL, OPT_AUTHOR_CHURN },
+    { "languages", no_argument, NULL, OPT_LANGUAGES },
+    { "timeline", required_argument, NULL, OPT_TIMELINE },
+    { "deadline", required_argument, NULL, OPT_DEADLINE },
+    { "progress", no_argument, NULL, OPT_PROGRESS },
+    { "status-file", required_argument, NULL, OPT_STATUS_FILE },
+    { "progress-interval", required_argument, NULL, OPT_PROGRESS_INTERVAL },
+    { "survival", no_argument, NULL, OPT_SURVIVAL },
+    { "coupling", required_argument, NULL, OPT_COUPLING },
+    { NULL, 0, NULL, 0 },
+};
+
+static void usage(const char* basename);
+static int print_row(const churnrow* row, void* payload);
+static int merge_sketches(FILE* in, FILE* out);
+static int write_timeline(const char* path);
+
+static void usage(const char* basename) {
+    printf("Usage: %s [option]... [file]\n", basename);
+    printf("  h\tPrints this message\n");
+    printf("  a <budget>\tEstimate churn from a sample of about budget "
+           "diffs and files,\n\tat least 6 per row\n");
+    printf("  b\tWrite binary columnar output instead of CSV\n");
+    printf("  c\tOnly count lines of code\n");
+    printf("  j <threads>\tNumber of threads used for diffing\n");
+    printf("  k\tAdd a mergeable sketch of the authors to each row\n");
+    printf("  m calculate churn separately for each month\n");
+    printf("  p first|all\tDiff each commit against its first parent or "
+           "all parents\n\tinstead of its predecessor in time\n");
+    printf("  r renames|copies\tDetect renamed (and copied) files\n");
+    printf("  R <pairs>\tMaximum number of file pairs scored for "
+           "similarity per diff\n");
+    printf("  y calculate churn separately for each year\n");
+    printf("  v\tPrint cache statistics to stderr\n");
+    printf("  s <socket>\tServe queries on a UNIX domain socket\n");
+    printf("  q <socket>\tSend the remaining arguments as a query to a "
+           "server\n");
+    printf("  --checkpoint <file>\tSave the state of an interval analysis "
+           "to file\n");
+    printf("  --checkpoint-interval <seconds>\tTime between checkpoints "
+           "(default %d)\n",
+        CHECKPOINT_SECONDS);
+    printf("  --resume\tContinue from the checkpoint, if there is one\n");
+    printf("  --changed-paths\tBuild and use changed-path filters to skip "
+           "diffs that\n\tcannot match the extension\n");
+    printf("  --graph-cache\tKeep parents, times and authors of commits in "
+           "a cache,\n\tso that later runs do not parse them again; "
+           "without it, interval\n\tanalyses parse every commit for its "
+           "author\n");
+    printf("  --author-churn <file>\tWrite the churn of each author in each "
+           "row to file\n");
+    printf("  --languages\tReport churn and lines of code per language "
+           "instead of\n\tfiltering by extension\n");
+    printf("  --timeline <file>\tRecord the hot paths of the analysis and "
+           "write them\n\tto file as Chrome trace JSON\n");
+    printf("  --deadline <seconds>\tStop after seconds and report the "
+           "finished intervals\n\tand a partial row, exit with status %d\n",
+        EXIT_PARTIAL);
+    printf("  --progress\tPrint the progress of the analysis to stderr\n");
+    printf("  --status-file <file>\tKeep the progress of the analysis in "
+           "file\n");
+    printf("  --progress-interval <seconds>\tTime between progress reports "
+           "(default %d)\n",
+        PROGRESS_SECONDS);
+    printf("  --survival\tCount the added lines of each row that survive "
+           "until HEAD\n");
+    printf("  --coupling <file>\tWrite the files and directories changed "
+           "together most\n\toften in each row to file\n");
+    printf("  --merge-sketches\tMerge the author sketches read from stdin "
+           "and print\n\tthe number of distinct authors and the merged "
+           "sketch\n");
+    printf("\n");
+}
+
+static int print_row(const churnrow* row, void* payload) {
+    return output_row((output*)payload, row);
+}
+
+/* every field that holds a sketch is merged, so rows of churny -k can be
+ * piped in as they are, e.g., the months of a quarter or of several
+ * repositories */
+static int merge_sketches(FILE* in, FILE* out) {
+    const char id[] = "merge_sketches";
+    char encoded[HLL_ENCODED_LENGTH + 1];
+    char* line = NULL;
+    size_t capacity = 0;
+    hll total;
+    hll sketch;
+    int error = 0;
+
+    hll_init(&total);
+    while (error == 0 && getline(&line, &capacity, in) != -1) {
+        char* saveptr;
+        char* field = strtok_r(line, ";\r\n", &saveptr);
+
+        while (field != NULL) {
+            if (!strncmp(field, HLL_PREFIX, strlen(HLL_PREFIX))) {
+                if (hll_decode(&sketch, field) < 0) {
+                    fprintf(stderr, "%s %s - Invalid sketch\n", fatal, id);
+                    error = -1;
+                    break;
+                }
+                hll_merge(&total, &sketch);
+            }
+            field = strtok_r(NULL, ";\r\n", &saveptr);
+        }
+    }
+    free(line);
+
+    if (error == 0) {
+        hll_encode(encoded, &total);
+        fprintf(out, "%.0f;%s\n", hll_count(&total), encoded);
+    }
+    return error;
+}
+
+/* all threads must have finished */
+static int write_timeline(const char* path) {
+    const char id[] = "write_timeline";
+    int error = timeline_write(path);
+
+    if (error < 0) {
+        fprintf(stderr, "%s %s - Could not write %s\n", fatal, id, path);
+    }
+    timeline_disable();
+    return error;
+}
+
+int main(int argc, char** argv) {
+    const char id[] = "main";
+
+#if defined(DEBUG) || defined(TRACE)
+    /* print program call */
+    print_debug("%s %s - program call ", debug, id);
+    int i;
+    for (i = 0; i < argc; i++) {
+        print_debug("%s", argv[i]);
+        if (i < argc - 1) {
+            print_debug(" ");
+        }
+    }
+    print_debug("\n");
+#endif
+
+    /* parse arguments */
+    int c;
+    interval interval = 0;
+    bool count_only = false;
+    bool print_stats = false;
+    outputformat format = CSV;
+    char extension[255] = "";
+    int num_threads = 0;
+    int sample_budget = 0;
+    diffmode diff_mode = ADJACENT;
+    renamemode renames = NO_RENAMES;
+    long rename_limit = RENAME_LIMIT;
+    char* serve_socket = NULL;
+    char* query_socket = NULL;
+    char* checkpoint_path = NULL;
+    int checkpoint_seconds = CHECKPOINT_SECONDS;
+    bool resume = false;
+    bool author_sketches = false;
+    bool changed_paths = false;
+    bool graph_cache = false;
+    char* author_churn_path = NULL;
+    bool languages = false;
+    char* timeline_path = NULL;
+    int deadline_seconds = 0;
+    bool progress = false;
+    char* status_path = NULL;
+    int progress_seconds = PROGRESS_SECONDS;
+    bool survival = false;
+    char* coupling_path = NULL;
+
+    while ((c = getopt_long(
+                argc, argv, "a:bchj:kl:mp:q:r:R:s:vy", long_options, NULL))
+        != -1) {
+        switch (c) {
+        case OPT_CHECKPOINT:
+            checkpoint_path = optarg;
+            break;
+        case OPT_CHECKPOINT_INTERVAL:
+            checkpoint_seconds = atoi(optarg);
+            break;
+        case OPT_RESUME:
+            resume = true;
+            break;
+        case OPT_CHANGED_PATHS:
+            changed_paths = true;
+            break;
+        case OPT_GRAPH_CACHE:
+            graph_cache = true;
+            break;
+        case OPT_AUTHOR_CHURN:
+            author_churn_path = optarg;
+            break;
+        case OPT_LANGUAGES:
+            languages = true;
+            break;
+        case OPT_TIMELINE:
+            timeline_path = optarg;
+            break;
+        case OPT_DEADLINE:
+            deadline_seconds = atoi(optarg);
+            break;
+        case OPT_PROGRESS:
+            progress = true;
+            break;
+        case OPT_STATUS_FILE:
+            status_path = optarg;
+            break;
+        case OPT_PROGRESS_INTERVAL:
+            progress_seconds = atoi(optarg);
+            break;
+        case OPT_SURVIVAL:
+            survival = true;
+            break;
+        case OPT_COUPLING:
+            coupling_path = optarg;
+            break;
+        case OPT_MERGE_SKETCHES:
+            return merge_sketches(stdin, stdout) < 0 ? EXIT_FAILURE
+                                                     : EXIT_SUCCESS;
+        case 'h':
+            usage(argv[0]);
+            return EXIT_SUCCESS;
+        case 'a':
+            sample_budget = atoi(optarg);
+            break;
+        case 'b':
+            format = BINARY;
+            break;
+        case 'c':
+            count_only = true;
+            break;
+        case 'j':
+            num_threads = atoi(optarg);
+            break;
+        case 'k':
+            author_sketches = true;
+            break;
+        case 'l':
+            strcpy(extension, optarg);
+            break;
+        case 'm':
+            interval = MONTH;
+            break;
+        case 'p':
+            if (!strcmp(optarg, "first")) {
+                diff_mode = FIRST_PARENT;
+            } else if (!strcmp(optarg, "all")) {
+                diff_mode = ALL_PARENTS;
+            } else {
+                fprintf(stderr, "%s %s - Unknown parent mode: %s\n", fatal,
+                    id, optarg);
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'q':
+            query_socket = optarg;
+            break;
+        case 'r':
+            if (!strcmp(optarg, "renames")) {
+                renames = RENAMES;
+            } else if (!strcmp(optarg, "copies")) {
+                renames = COPIES;
+            } else {
+                fprintf(stderr, "%s %s - Unknown rename mode: %s\n", fatal,
+                    id, optarg);
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'R':
+            rename_limit = atol(optarg);
+            break;
+        case 's':
+            serve_socket = optarg;
+            break;
+        case 'v':
+            print_stats = true;
+            break;
+        case 'y':
+            interval = YEAR;
+            break;
+        default:
+            printf("?? getopt returned character code "
+                   "0%o ??\n",
+                c);
+        }
+    }
+
+    char* path = NULL;
+    churny_ctx* ctx = NULL;
+    bool partial = false;
+    int error = 0;
+
+    /* only interval analyses have a state worth saving */
+    if ((checkpoint_path != NULL || resume)
+        && (interval == 0 || checkpoint_path == NULL)) {
+        fprintf(stderr, "%s %s - Checkpoints need --checkpoint and -m or "
+                        "-y\n",
+            fatal, id);
+        return EXIT_FAILURE;
+    }
+
+    /* estimated rows are only known once the whole history is walked,
+     * and a resumed walk would draw a different sample */
+    if (checkpoint_path != NULL && sample_budget > 0) {
+        fprintf(stderr, "%s %s - Checkpoints cannot be combined with -a\n",
+            fatal, id);
+        return EXIT_FAILURE;
+    }
+
+    /* rows replayed from a checkpoint and estimated rows
+     * have no churn per author */
+    if (author_churn_path != NULL
+        && (checkpoint_path != NULL || sample_budget > 0
+               || query_socket != NULL)) {
+        fprintf(stderr, "%s %s - --author-churn cannot be combined with "
+                        "checkpoints, -a or -q\n",
+            fatal, id);
+        return EXIT_FAILURE;
+    }
+
+    /* the same holds for the files changed together */
+    if (coupling_path != NULL
+        && (checkpoint_path != NULL || sample_budget > 0 || languages
+               || query_socket != NULL)) {
+        fprintf(stderr, "%s %s - --coupling cannot be combined with "
+                        "checkpoints, -a, -q or --languages\n",
+            fatal, id);
+        return EXIT_FAILURE;
+    }
+
+    /* languages replace the extension, and estimates are not broken
+     * down any further */
+    if (languages
+        && (strlen(extension) > 0 || sample_budget > 0
+               || author_churn_path != NULL || query_socket != NULL)) {
+        fprintf(stderr, "%s %s - --languages cannot be combined with -l, "
+                        "-a, -q or --author-churn\n",
+            fatal, id);
+        return EXIT_FAILURE;
+    }
+
+    /* lines are followed back from HEAD over a chain of diffs,
+     * which neither a sample nor a resumed walk has */
+    if (survival
+        && (interval == 0 || sample_budget > 0 || diff_mode == ALL_PARENTS
+               || checkpoint_path != NULL || query_socket != NULL)) {
+        fprintf(stderr, "%s %s - --survival needs -m or -y, without -a, "
+                        "-p all, checkpoints or -q\n",
+            fatal, id);
+        return EXIT_FAILURE;
+    }
+
+    /* estimates are only known at the end of the walk, and servers
+     * answer queries as long as they need */
+    if (deadline_seconds > 0
+        && (sample_budget > 0 || serve_socket != NULL
+               || query_socket != NULL)) {
+        fprintf(stderr, "%s %s - --deadline cannot be combined with -a, -s "
+                        "or -q\n",
+            fatal, id);
+        return EXIT_FAILURE;
+    }
+    if ((progress || status_path != NULL)
+        && (serve_socket != NULL || query_socket != NULL)) {
+        fprintf(stderr, "%s %s - Progress reports cannot be combined with "
+                        "-s or -q\n",
+            fatal, id);
+        return EXIT_FAILURE;
+    }
+
+    if (timeline_path != NULL) {
+        timeline_enable();
+    }
+
+    if (serve_socket != NULL) {
+        /* keep running until a client asks us to shut down */
+        error = churny_serve(serve_socket);
+        if (timeline_path != NULL && write_timeline(timeline_path) < 0) {
+            error = -1;
+        }
+        return error < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    if (query_socket != NULL) {
+        /* the remaining arguments form the request,
+         * getopt may already have consumed the extension */
+        size_t length = strlen(" -l ") + strlen(extension)
+            + strlen(" -p first") + strlen(" -r renames") + strlen(" -k") + 1;
+        int i;
+        for (i = optind; i < argc; i++) {
+            length = length + strlen(argv[i]) + 1;
+        }
+
+        char request[length];
+        request[0] = '\0';
+        for (i = optind; i < argc; i++) {
+            strcat(request, argv[i]);
+            if (i < argc - 1) {
+                strcat(request, " ");
+            }
+        }
+        if (strlen(extension) > 0) {
+            strcat(request, " -l ");
+            strcat(request, extension);
+        }
+        if (diff_mode != ADJACENT) {
+            strcat(
+                request, diff_mode == FIRST_PARENT ? " -p first" : " -p all");
+        }
+        if (renames != NO_RENAMES) {
+            strcat(request, renames == RENAMES ? " -r renames" : " -r copies");
+        }
+        if (author_sketches) {
+            strcat(request, " -k");
+        }
+
+        return churny_query(query_socket, request, stdout) < 0 ? EXIT_FAILURE
+                                                              : EXIT_SUCCESS;
+    }
+
+#if defined(DEBUG) || defined(TRACE)
+    print_debug("argc = %d\noptind = %d\n", argc, optind);
+#endif
+
+    switch (argc - optind) {
+    case 0:
+        /* at least one argument is required */
+        fprintf(stderr, "%s %s - At least one argument is "
+                        "required!\n",
+            fatal, id);
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    case 1:
+        /* a git repository is expected */
+        path = argv[optind];
+
+#if defined(DEBUG) || defined(TRACE)
+        print_debug("%s %s - path = \"%s\"\n", debug, id, path);
+#endif
+        /* make sure path exists and is a directory */
+        struct stat s;
+        int err = stat(path, &s);
+        if (err != -1 && S_ISDIR(s.st_mode)) {
+
+#if defined(DEBUG) || defined(TRACE)
+            print_debug("%s %s - Directory exists: %s\n", debug, id, path);
+#endif
+
+            /* initialize repo, which may be a working directory
+             * or a bare repository */
+            if (churny_open(&ctx, path) == 0) {
+
+#if defined(DEBUG) || defined(TRACE)
+                print_debug("%s %s - "
+                            "Initialized "
+                            "repository: "
+                            "%s\n",
+                    debug, id, path);
+#endif
+
+            } else {
+                exit_error(EXIT_FAILURE, "%s %s - Is not a git "
+                                         "repository: %s\n",
+                    fatal, id, path);
+            }
+        } else if (err == -1) {
+            perror("stat");
+            exit(err);
+        } else {
+            exit_error(EXIT_FAILURE, "%s %s - Is not a "
+                                     "directory: %s\n",
+                fatal, id, path);
+        }
+        break;
+    case 2:
+        /* either two tars or two directories are expected */
+#if defined(DEBUG) || defined(TRACE)
+        print_debug("%s %s - Expecting two tars or two "
+                    "directories\n",
+            debug, id);
+#endif
+        break;
+    default:
+        fprintf(stderr, "%s %s - Wrong amount of arguments: "
+                        "%d!\n",
+            fatal, id, argc - optind);
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (ctx != NULL) {
+        if (num_threads > 0) {
+            churny_set_threads(ctx, num_threads);
+        }
+        churny_set_sampling(ctx, sample_budget);
+        churny_set_diff_mode(ctx, diff_mode);
+        churny_set_renames(
+            ctx, renames, rename_limit > 0 ? (size_t)rename_limit : 0);
+        churny_set_author_sketches(ctx, author_sketches);
+        churny_set_author_churn(ctx, author_churn_path != NULL);
+        churny_set_languages(ctx, languages);
+        churny_set_survival(ctx, survival);
+        churny_set_coupling(ctx, coupling_path != NULL);
+        churny_set_graph_cache(ctx, graph_cache);
+        if (changed_paths && churny_set_changed_paths(ctx, true) < 0) {
+            exit_error(EXIT_FAILURE, "%s %s - Out of memory\n", fatal, id);
+        }
+        if (checkpoint_path != NULL
+            && churny_set_checkpoint(
+                   ctx, checkpoint_path, checkpoint_seconds, resume)
+                < 0) {
+            exit_error(EXIT_FAILURE, "%s %s - Out of memory\n", fatal, id);
+        }
+        if (churny_set_progress(ctx, progress ? stderr : NULL, status_path,
+                progress_seconds)
+            < 0) {
+            exit_error(EXIT_FAILURE, "%s %s - Out of memory\n", fatal, id);
+        }
+        if (deadline_seconds > 0) {
+            churny_set_deadline(ctx, time(NULL) + deadline_seconds);
+        }
+
+        /* run the actual analysis */
+        if (count_only) {
+            /* only count LOC, print result and exit */
+            if (git_repository_is_bare(ctx->repo)) {
+                /* there are no files, so HEAD is counted */
+                git_oid head;
+                int loc;
+                if (git_reference_name_to_id(&head, ctx->repo, "HEAD") < 0
+                    || churny_loc(&loc, ctx, &head, extension) < 0) {
+                    exit_error(EXIT_FAILURE,
+                        "%s %s - Could not count lines of code of HEAD\n",
+                        fatal, id);
+                }
+                printf("%d\n", loc);
+            } else {
+                printf("%d\n", calculate_loc_dir(
+                                    git_repository_workdir(ctx->repo),
+                                    extension));
+            }
+        } else {
+            output* out = output_create(stdout, format);
+            out->approximate = sample_budget > 0;
+            out->sketched = author_sketches;
+            out->languages = languages;
+            out->survival = survival;
+            out->partial = deadline_seconds > 0;
+            if (author_churn_path != NULL
+                && (out->authors = fopen(author_churn_path, "w")) == NULL) {
+                exit_error(EXIT_FAILURE, "%s %s - Could not open %s\n", fatal,
+                    id, author_churn_path);
+            }
+            if (coupling_path != NULL
+                && (out->coupling = fopen(coupling_path, "w")) == NULL) {
+                exit_error(EXIT_FAILURE, "%s %s - Could not open %s\n", fatal,
+                    id, coupling_path);
+            }
+            output_header(out);
+            if (interval > 0) {
+                error = churny_foreach_interval(
+                    ctx, interval, extension, print_row, out);
+            } else {
+                error = calculate_code_churn(
+                    NULL, ctx, NULL, NULL, extension, print_row, out);
+            }
+            if (error < 0) {
+                print_error("%s\n", churny_error(ctx));
+            } else if (ctx->expired) {
+                fprintf(stderr, "%s - Deadline reached, the last row is "
+                                "partial\n",
+                    id);
+            }
+            if (error >= 0 && output_finish(out) < 0) {
+                print_error("%s %s - Could not write output\n", fatal, id);
+                error = -1;
+            }
+            if (out->authors != NULL && fclose(out->authors) != 0) {
+                print_error("%s %s - Could not write %s\n", fatal, id,
+                    author_churn_path);
+                error = -1;
+            }
+            if (out->coupling != NULL && fclose(out->coupling) != 0) {
+                print_error(
+                    "%s %s - Could not write %s\n", fatal, id, coupling_path);
+                error = -1;
+            }
+            output_destroy(out);
+        }
+
+        partial = ctx->expired;
+
+        if (print_stats) {
+            churny_stats stats;
+            churny_get_stats(&stats, ctx);
+            churny_print_stats(stderr, &stats);
+        }
+
+        /* cleanup */
+        churny_free(ctx);
+    }
+
+    /* the workers are gone now */
+    if (timeline_path != NULL && write_timeline(timeline_path) < 0) {
+        error = -1;
+    }
+
+    if (error < 0) {
+        return EXIT_FAILURE;
+    }
+    return partial ? EXIT_PARTIAL : EXIT_SUCCESS;
+}
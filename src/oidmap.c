@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+#include "oidmap.h"
+
+/* object ids are uniformly distributed,
+ * so their first bytes make a good hash */
+static size_t oid_hash(const git_oid* oid) {
+    size_t hash;
+    memcpy(&hash, oid->id, sizeof(hash));
+    return hash;
+}
+
+static oidmap_entry* find_slot(
+    oidmap_entry* entries, size_t capacity, const git_oid* key) {
+    size_t i = oid_hash(key) & (capacity - 1);
+
+    while (entries[i].used
+        && memcmp(entries[i].key.id, key->id, GIT_OID_RAWSZ) != 0) {
+        i = (i + 1) & (capacity - 1);
+    }
+
+    return &entries[i];
+}
+
+static int grow(oidmap* map) {
+    size_t capacity = map->capacity == 0 ? 64 : 2 * map->capacity;
+    oidmap_entry* entries = calloc(capacity, sizeof(oidmap_entry));
+    size_t i;
+
+    if (entries == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < map->capacity; i++) {
+        if (map->entries[i].used) {
+            *find_slot(entries, capacity, &map->entries[i].key)
+                = map->entries[i];
+        }
+    }
+
+    free(map->entries);
+    map->entries = entries;
+    map->capacity = capacity;
+    return 0;
+}
+
+oidmap* oidmap_create() {
+    oidmap* map = (oidmap*)malloc(sizeof(oidmap));
+    map->entries = NULL;
+    map->size = 0;
+    map->capacity = 0;
+    return map;
+}
+
+bool oidmap_get(oidmap* map, const git_oid* key, void** value) {
+    if (map->size == 0) {
+        return false;
+    }
+
+    oidmap_entry* entry = find_slot(map->entries, map->capacity, key);
+
+    if (!entry->used) {
+        return false;
+    }
+
+    if (value != NULL) {
+        *value = entry->value;
+    }
+
+    return true;
+}
+
+int oidmap_set(oidmap* map, const git_oid* key, void* value) {
+    /* keep the load factor below 3/4 */
+    if (4 * (map->size + 1) > 3 * map->capacity && grow(map) < 0) {
+        return -1;
+    }
+
+    oidmap_entry* entry = find_slot(map->entries, map->capacity, key);
+
+    if (!entry->used) {
+        entry->used = true;
+        entry->key = *key;
+        map->size = map->size + 1;
+    }
+
+    entry->value = value;
+    return 0;
+}
+
+bool oidmap_next(oidmap* map, size_t* iter, git_oid* key, void** value) {
+    while (*iter < map->capacity) {
+        oidmap_entry* entry = &map->entries[*iter];
+        *iter = *iter + 1;
+
+        if (entry->used) {
+            if (key != NULL) {
+                *key = entry->key;
+            }
+            if (value != NULL) {
+                *value = entry->value;
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+size_t oidmap_size(oidmap* map) { return map->size; }
+
+void oidmap_clear(oidmap* map) {
+    if (map->entries != NULL) {
+        memset(map->entries, 0, map->capacity * sizeof(oidmap_entry));
+    }
+    map->size = 0;
+}
+
+void oidmap_destroy(oidmap* map) {
+    free(map->entries);
+    free(map);
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+#ifndef OIDMAP_H_ /* Include guard */
+#define OIDMAP_H_
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <git2.h>
+
+/* hash map from object ids to arbitrary values (open addressing) */
+typedef struct {
+    git_oid key;
+    void* value;
+    bool used;
+} oidmap_entry;
+
+typedef struct {
+    oidmap_entry* entries;
+    size_t size;
+    size_t capacity;
+} oidmap;
+
+oidmap* oidmap_create();
+
+bool oidmap_get(oidmap* map, const git_oid* key, void** value);
+
+int oidmap_set(oidmap* map, const git_oid* key, void* value);
+
+bool oidmap_next(oidmap* map, size_t* iter, git_oid* key, void** value);
+
+size_t oidmap_size(oidmap* map);
+
+void oidmap_clear(oidmap* map);
+
+void oidmap_destroy(oidmap* map);
+
+#endif
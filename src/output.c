@@ -0,0 +1,467 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+#include "output.h"
+
+/* schema of the binary columnar format, in column order */
+static const struct {
+    const char* name;
+    uint32_t type;
+    uint32_t width;
+} columns[] = {
+    { "base_date", CHURNY_COL_INT64, 8 },
+    { "last_date", CHURNY_COL_INT64, 8 },
+    { "base_id", CHURNY_COL_OID, GIT_OID_RAWSZ },
+    { "last_id", CHURNY_COL_OID, GIT_OID_RAWSZ },
+    { "commits", CHURNY_COL_UINT32, 4 },
+    { "authors", CHURNY_COL_UINT32, 4 },
+    { "base_loc", CHURNY_COL_UINT32, 4 },
+    { "last_loc", CHURNY_COL_UINT32, 4 },
+    { "ratio", CHURNY_COL_FLOAT64, 8 },
+    { "added_loc", CHURNY_COL_UINT64, 8 },
+    { "removed_loc", CHURNY_COL_UINT64, 8 },
+    { "changed_loc", CHURNY_COL_UINT64, 8 },
+    { "relative_churn", CHURNY_COL_FLOAT64, 8 },
+    /* approximate results only */
+    { "base_loc_ci", CHURNY_COL_FLOAT64, 8 },
+    { "last_loc_ci", CHURNY_COL_FLOAT64, 8 },
+    { "added_loc_ci", CHURNY_COL_FLOAT64, 8 },
+    { "removed_loc_ci", CHURNY_COL_FLOAT64, 8 },
+    { "changed_loc_ci", CHURNY_COL_FLOAT64, 8 },
+    /* author sketches only */
+    { "author_sketch", CHURNY_COL_HLL, HLL_REGISTERS },
+    /* languages only */
+    { "language", CHURNY_COL_STRING, 16 },
+    /* survival only */
+    { "surviving_loc", CHURNY_COL_UINT64, 8 },
+    /* deadline only */
+    { "partial", CHURNY_COL_UINT32, 4 },
+};
+
+#define NUM_COLUMNS (sizeof(columns) / sizeof(columns[0]))
+#define NUM_EXACT_COLUMNS 13
+#define SKETCH_COLUMN 18
+#define LANGUAGE_COLUMN 19
+#define SURVIVING_COLUMN 20
+#define PARTIAL_COLUMN 21
+
+static size_t align8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+static void write_value(char* dst, const churnrow* row, size_t column) {
+    int64_t i64;
+    uint32_t u32;
+    uint64_t u64;
+    double f64;
+
+    switch (column) {
+    case 0:
+        i64 = row->first_time;
+        memcpy(dst, &i64, sizeof(i64));
+        break;
+    case 1:
+        i64 = row->last_time;
+        memcpy(dst, &i64, sizeof(i64));
+        break;
+    case 2:
+        memcpy(dst, row->first.id, GIT_OID_RAWSZ);
+        break;
+    case 3:
+        memcpy(dst, row->last.id, GIT_OID_RAWSZ);
+        break;
+    case 4:
+        u32 = row->num_commits;
+        memcpy(dst, &u32, sizeof(u32));
+        break;
+    case 5:
+        u32 = row->num_authors;
+        memcpy(dst, &u32, sizeof(u32));
+        break;
+    case 6:
+        u32 = row->first_loc;
+        memcpy(dst, &u32, sizeof(u32));
+        break;
+    case 7:
+        u32 = row->last_loc;
+        memcpy(dst, &u32, sizeof(u32));
+        break;
+    case 8:
+        f64 = row->ratio;
+        memcpy(dst, &f64, sizeof(f64));
+        break;
+    case 9:
+        u64 = row->diff.insertions;
+        memcpy(dst, &u64, sizeof(u64));
+        break;
+    case 10:
+        u64 = row->diff.deletions;
+        memcpy(dst, &u64, sizeof(u64));
+        break;
+    case 11:
+        u64 = row->diff.changes;
+        memcpy(dst, &u64, sizeof(u64));
+        break;
+    case 12:
+        f64 = row->churn;
+        memcpy(dst, &f64, sizeof(f64));
+        break;
+    case 13:
+        memcpy(dst, &row->margin.first_loc, sizeof(double));
+        break;
+    case 14:
+        memcpy(dst, &row->margin.last_loc, sizeof(double));
+        break;
+    case 15:
+        memcpy(dst, &row->margin.insertions, sizeof(double));
+        break;
+    case 16:
+        memcpy(dst, &row->margin.deletions, sizeof(double));
+        break;
+    case 17:
+        memcpy(dst, &row->margin.changes, sizeof(double));
+        break;
+    case SKETCH_COLUMN:
+        memcpy(dst, row->authors.registers, HLL_REGISTERS);
+        break;
+    case LANGUAGE_COLUMN:
+        strncpy(dst, language_name(row->language), columns[column].width);
+        break;
+    case SURVIVING_COLUMN:
+        u64 = row->surviving;
+        memcpy(dst, &u64, sizeof(u64));
+        break;
+    case PARTIAL_COLUMN:
+        u32 = row->partial;
+        memcpy(dst, &u32, sizeof(u32));
+        break;
+    }
+}
+
+static void print_csv_row(FILE* stream, const churnrow* row,
+    bool approximate, bool sketched, bool languages, bool survival,
+    bool partial) {
+    int time_string_length = strlen("2014-10-23") + 1;
+    char first_time_string[time_string_length];
+    char last_time_string[time_string_length];
+    char first_sha[10] = { 0 };
+    char last_sha[10] = { 0 };
+    git_oid_tostr(first_sha, 9, &row->first);
+    git_oid_tostr(last_sha, 9, &row->last);
+    time_t t;
+    struct tm* tm;
+
+    /* dates only: the old "%F %H:%M" did not fit this buffer, strftime()
+     * failed and glibc happened to leave just the date in it */
+    t = row->first_time;
+    tm = gmtime(&t);
+    strftime(first_time_string, time_string_length, "%F", tm);
+    t = row->last_time;
+    tm = gmtime(&t);
+    strftime(last_time_string, time_string_length, "%F", tm);
+
+    char sketch[HLL_ENCODED_LENGTH + 2] = "";
+    if (sketched) {
+        sketch[0] = ';';
+        hll_encode(sketch + 1, &row->authors);
+    }
+
+    char language[32] = "";
+    if (languages) {
+        language[0] = ';';
+        strncpy(language + 1, language_name(row->language),
+            sizeof(language) - 2);
+    }
+
+    char surviving[24] = "";
+    if (survival) {
+        snprintf(surviving, sizeof(surviving), ";%lu", row->surviving);
+    }
+
+    const char* marker = "";
+    if (partial) {
+        marker = row->partial ? ";1" : ";0";
+    }
+
+    if (approximate) {
+        fprintf(stream, "%s;%s;%s;%s;%d;%d;%d;%.0f;%d;%.0f;%.2f;%lu;%.0f;"
+                        "%lu;%.0f;%lu;%.0f;%.2f%s%s%s%s\n",
+            first_time_string, last_time_string, first_sha, last_sha,
+            row->num_commits, row->num_authors, row->first_loc,
+            row->margin.first_loc, row->last_loc, row->margin.last_loc,
+            row->ratio, row->diff.insertions, row->margin.insertions,
+            row->diff.deletions, row->margin.deletions, row->diff.changes,
+            row->margin.changes, row->churn, sketch, language, surviving,
+            marker);
+        return;
+    }
+
+    fprintf(stream, "%s;%s;%s;%s;%d;%d;%d;%d;%.2f;%lu;"
+                    "%lu;%lu;%.2f%s%s%s%s\n",
+        first_time_string, last_time_string, first_sha, last_sha,
+        row->num_commits, row->num_authors, row->first_loc, row->last_loc,
+        row->ratio, row->diff.insertions, row->diff.deletions,
+        row->diff.changes, row->churn, sketch, language, surviving, marker);
+}
+
+/* one line per author of the row, which is identified by its ids */
+static void print_author_rows(FILE* stream, const churnrow* row) {
+    int time_string_length = strlen("2014-10-23") + 1;
+    char first_time_string[time_string_length];
+    char last_time_string[time_string_length];
+    char first_sha[10] = { 0 };
+    char last_sha[10] = { 0 };
+    git_oid_tostr(first_sha, 9, &row->first);
+    git_oid_tostr(last_sha, 9, &row->last);
+    time_t t;
+    struct tm* tm;
+    int i;
+
+    t = row->first_time;
+    tm = gmtime(&t);
+    strftime(first_time_string, time_string_length, "%F", tm);
+    t = row->last_time;
+    tm = gmtime(&t);
+    strftime(last_time_string, time_string_length, "%F", tm);
+
+    for (i = 0; i < row->num_authors; i++) {
+        const authorchurn* a = &row->author_churn[i];
+        const char* c;
+
+        fprintf(stream, "%s;%s;%s;%s;", first_time_string, last_time_string,
+            first_sha, last_sha);
+        /* the separator must not appear in names */
+        for (c = a->name; *c != '\0'; c++) {
+            fputc(*c == ';' ? ',' : *c, stream);
+        }
+        fprintf(stream, ";%d;%lu;%lu;%lu\n", a->num_commits,
+            a->diff.insertions, a->diff.deletions, a->diff.changes);
+    }
+}
+
+/* one line per coupled pair of the row, the degree is the share of the
+ * commits of both that changed them together */
+static void print_coupling_rows(FILE* stream, const churnrow* row) {
+    int time_string_length = strlen("2014-10-23") + 1;
+    char first_time_string[time_string_length];
+    char last_time_string[time_string_length];
+    char first_sha[10] = { 0 };
+    char last_sha[10] = { 0 };
+    git_oid_tostr(first_sha, 9, &row->first);
+    git_oid_tostr(last_sha, 9, &row->last);
+    time_t t;
+    struct tm* tm;
+    size_t i;
+
+    t = row->first_time;
+    tm = gmtime(&t);
+    strftime(first_time_string, time_string_length, "%F", tm);
+    t = row->last_time;
+    tm = gmtime(&t);
+    strftime(last_time_string, time_string_length, "%F", tm);
+
+    for (i = 0; i < row->num_coupling; i++) {
+        const coupledpair* c = &row->coupling[i];
+
+        fprintf(stream, "%s;%s;%s;%s;%s;%s;%s;%d;%d;%d;%.2f\n",
+            first_time_string, last_time_string, first_sha, last_sha,
+            c->directories ? "directory" : "file", c->first, c->second,
+            c->num_commits, c->first_commits, c->second_commits,
+            2.0 * c->num_commits / (c->first_commits + c->second_commits));
+    }
+}
+
+static int write_binary(output* out) {
+    /* compute the layout first, so that everything
+     * can be written in one sequential pass */
+    size_t selected[NUM_COLUMNS];
+    size_t num_columns = 0;
+    size_t offsets[NUM_COLUMNS];
+    size_t offset;
+    size_t c;
+    size_t r;
+
+    for (c = 0; c < NUM_COLUMNS; c++) {
+        if ((c < NUM_EXACT_COLUMNS)
+            || (c < SKETCH_COLUMN && out->approximate)
+            || (c == SKETCH_COLUMN && out->sketched)
+            || (c == LANGUAGE_COLUMN && out->languages)
+            || (c == SURVIVING_COLUMN && out->survival)
+            || (c == PARTIAL_COLUMN && out->partial)) {
+            selected[num_columns] = c;
+            num_columns = num_columns + 1;
+        }
+    }
+
+    offset = align8(sizeof(churny_bin_header)
+        + num_columns * sizeof(churny_bin_column));
+    for (c = 0; c < num_columns; c++) {
+        offsets[c] = offset;
+        offset = align8(offset + out->size * columns[selected[c]].width);
+    }
+
+    char* buf = calloc(1, offset);
+    if (buf == NULL) {
+        return -1;
+    }
+
+    churny_bin_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHURNY_BIN_MAGIC, sizeof(CHURNY_BIN_MAGIC));
+    header.version = CHURNY_BIN_VERSION;
+    header.byte_order = CHURNY_BIN_BYTE_ORDER;
+    header.num_rows = out->size;
+    header.num_columns = num_columns;
+    memcpy(buf, &header, sizeof(header));
+
+    for (c = 0; c < num_columns; c++) {
+        size_t s = selected[c];
+        churny_bin_column column;
+        memset(&column, 0, sizeof(column));
+        strncpy(column.name, columns[s].name, sizeof(column.name) - 1);
+        column.type = columns[s].type;
+        column.width = columns[s].width;
+        column.offset = offsets[c];
+        memcpy(buf + sizeof(header) + c * sizeof(column), &column,
+            sizeof(column));
+
+        for (r = 0; r < out->size; r++) {
+            write_value(
+                buf + offsets[c] + r * columns[s].width, &out->rows[r], s);
+        }
+    }
+
+    size_t written = fwrite(buf, 1, offset, out->stream);
+    free(buf);
+
+    if (written != offset || fflush(out->stream) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+output* output_create(FILE* stream, outputformat format) {
+    output* out = (output*)malloc(sizeof(output));
+    out->format = format;
+    out->approximate = false;
+    out->sketched = false;
+    out->languages = false;
+    out->survival = false;
+    out->partial = false;
+    out->stream = stream;
+    out->authors = NULL;
+    out->coupling = NULL;
+    out->rows = NULL;
+    out->size = 0;
+    out->capacity = 0;
+    return out;
+}
+
+void output_header(output* out) {
+    const char* sketch = out->sketched ? ";Author Sketch" : "";
+    const char* language = out->languages ? ";Language" : "";
+    const char* surviving = out->survival ? ";Surviving LoC" : "";
+    const char* partial = out->partial ? ";Partial" : "";
+
+    if (out->format == CSV && out->approximate) {
+        fprintf(out->stream, "%s%s%s%s%s\n",
+            "Base Date;Last Date;Base Id; Last Id;"
+            "Commits;Authors;Base LoC;Base LoC CI;"
+            "Last LoC;Last LoC CI;Ratio;Added LoC;"
+            "Added LoC CI;Removed LoC;"
+            "Removed LoC CI;Changed LoC;"
+            "Changed LoC CI;Relative Code Churn",
+            sketch, language, surviving, partial);
+    } else if (out->format == CSV) {
+        fprintf(out->stream, "%s%s%s%s%s\n",
+            "Base Date;Last Date;Base Id; Last Id;"
+            "Commits;Authors;Base LoC;Last LoC;"
+            "Ratio;Added LoC;Removed LoC;"
+            "Changed LoC;Relative Code Churn",
+            sketch, language, surviving, partial);
+    }
+
+    if (out->authors != NULL) {
+        fprintf(out->authors, "%s\n",
+            "Base Date;Last Date;Base Id; Last Id;"
+            "Author;Commits;Added LoC;Removed LoC;Changed LoC");
+    }
+
+    if (out->coupling != NULL) {
+        fprintf(out->coupling, "%s\n",
+            "Base Date;Last Date;Base Id; Last Id;"
+            "Kind;First;Second;Commits;First Commits;"
+            "Second Commits;Degree");
+    }
+}
+
+int output_row(output* out, const churnrow* row) {
+    if (out->authors != NULL && row->author_churn != NULL) {
+        print_author_rows(out->authors, row);
+    }
+    if (out->coupling != NULL && row->coupling != NULL) {
+        print_coupling_rows(out->coupling, row);
+    }
+
+    if (out->format == CSV) {
+        print_csv_row(out->stream, row, out->approximate, out->sketched,
+            out->languages, out->survival, out->partial);
+        return 0;
+    }
+
+    /* columnar output needs all rows before anything can be written */
+    if (out->size == out->capacity) {
+        size_t capacity = out->capacity == 0 ? 64 : 2 * out->capacity;
+        churnrow* rows = realloc(out->rows, capacity * sizeof(churnrow));
+        if (rows == NULL) {
+            return -1;
+        }
+        out->rows = rows;
+        out->capacity = capacity;
+    }
+
+    out->rows[out->size] = *row;
+    out->rows[out->size].author_churn = NULL;
+    out->rows[out->size].coupling = NULL;
+    out->size = out->size + 1;
+    return 0;
+}
+
+int output_finish(output* out) {
+    span s;
+    int error = 0;
+
+    TIMELINE_BEGIN(&s, flush);
+    if (out->authors != NULL && fflush(out->authors) != 0) {
+        error = -1;
+    } else if (out->format == BINARY) {
+        error = write_binary(out);
+    } else if (fflush(out->stream) != 0) {
+        error = -1;
+    }
+    TIMELINE_END(&s, flush);
+
+    return error;
+}
+
+void output_destroy(output* out) {
+    free(out->rows);
+    free(out);
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+#ifndef OUTPUT_H_ /* Include guard */
+#define OUTPUT_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <git2.h>
+#include "utils.h"
+#include "hll.h"
+#include "authors.h"
+#include "coupling.h"
+#include "lang.h"
+#include "timeline.h"
+
+typedef int outputformat;
+#define CSV 1
+#define BINARY 2
+
+/* half widths of the 95% confidence intervals of estimated values */
+typedef struct {
+    double first_loc;
+    double last_loc;
+    double insertions;
+    double deletions;
+    double changes;
+} churnmargin;
+
+/* one result row, i.e., the churn between a base and a last commit */
+typedef struct {
+    git_time_t first_time;
+    git_time_t last_time;
+    git_oid first;
+    git_oid last;
+    int num_commits;
+    int num_authors;
+    int first_loc;
+    int last_loc;
+    double ratio;
+    diffresult diff;
+    double churn;
+    bool approximate;
+    churnmargin margin;
+    bool sketched;
+    hll authors; /* sketch of the authors, if sketched */
+    /* churn of each of the num_authors authors, ordered by changed lines,
+     * only set with per-author churn and only valid during the callback */
+    const authorchurn* author_churn;
+    int language; /* of the counted files (see lang.h), -1 for all files */
+    /* the deadline passed before the interval was analyzed completely,
+     * only the commits walked and diffs finished in time are included */
+    bool partial;
+    /* lines added in the interval that are still there at the end of the
+     * walk, if survival is tracked */
+    unsigned long surviving;
+    /* pairs of files and of directories that were changed together most
+     * often, only set with coupling and only valid during the callback */
+    const coupledpair* coupling;
+    size_t num_coupling;
+} churnrow;
+
+/*
+ * Binary columnar format
+ *
+ * The file starts with a churny_bin_header, followed by num_columns
+ * churny_bin_column descriptors. The data of each column is stored
+ * contiguously (num_rows values of the given width) at the given offset,
+ * which is counted from the start of the file and aligned to 8 bytes.
+ * All integers are stored in host byte order, byte_order can be used
+ * to detect a mismatch. A consumer can mmap the file and cast
+ * base + offset to a pointer of the column type.
+ *
+ * Approximate results have five more FLOAT64 columns after the others,
+ * holding the confidence intervals of the estimated columns. With author
+ * sketches, the next column holds the HLL_REGISTERS registers of the
+ * HyperLogLog sketch of each row (see hll.h). With languages, the last
+ * column holds the name of the language of each row, padded with zeros.
+ * With survival, a UINT64 column holds the surviving lines, and with a
+ * deadline, the last column marks partial rows.
+ */
+#define CHURNY_BIN_MAGIC "CHURNYC"
+#define CHURNY_BIN_VERSION 1
+#define CHURNY_BIN_BYTE_ORDER 0x01020304
+
+/* column types */
+#define CHURNY_COL_INT64 1
+#define CHURNY_COL_UINT32 2
+#define CHURNY_COL_UINT64 3
+#define CHURNY_COL_FLOAT64 4
+#define CHURNY_COL_OID 5
+#define CHURNY_COL_HLL 6
+#define CHURNY_COL_STRING 7
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t num_rows;
+    uint32_t num_columns;
+    uint32_t reserved;
+} churny_bin_header;
+
+typedef struct {
+    char name[24];
+    uint32_t type;
+    uint32_t width;
+    uint64_t offset;
+} churny_bin_column;
+
+typedef struct {
+    outputformat format;
+    bool approximate;
+    bool sketched;
+    bool languages;
+    bool survival; /* rows have a column with the surviving lines */
+    bool partial; /* rows have a column that marks partial ones */
+    FILE* stream;
+    FILE* authors;  /* churn of each author as CSV, if not NULL */
+    FILE* coupling; /* pairs changed together as CSV, if not NULL */
+    churnrow* rows;
+    size_t size;
+    size_t capacity;
+} output;
+
+output* output_create(FILE* stream, outputformat format);
+
+void output_header(output* out);
+
+int output_row(output* out, const churnrow* row);
+
+int output_finish(output* out);
+
+void output_destroy(output* out);
+
+#endif
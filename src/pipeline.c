@@ -0,0 +1,886 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+#include "pipeline.h"
+
+/* a run of adjacent commit pairs, diffed by the same worker */
+struct diffjob {
+    pipeline* p;
+    int size;
+    diffpair pairs[DIFF_BATCH];
+};
+
+typedef struct {
+    pipeline* p;
+    bucket* b;
+    git_oid commit;
+    int* loc;
+    double* margin;
+    size_t sample_size;
+    int* languages; /* lines of code per language instead of loc */
+} locjob;
+
+/* a job that was not done leaves its bucket partial */
+static void finish_job(pipeline* p, bucket* b, int error, bool done) {
+    pthread_mutex_lock(&p->lock);
+    if (error < 0 && p->error == 0) {
+        p->error = error;
+    }
+    if (!done) {
+        b->partial = true;
+    }
+    b->pending = b->pending - 1;
+    p->pending = p->pending - 1;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* jobs that are still queued after an error or the deadline are skipped */
+static bool failed(pipeline* p) {
+    bool failed;
+    pthread_mutex_lock(&p->lock);
+    failed = p->error != 0 || p->expired;
+    pthread_mutex_unlock(&p->lock);
+    return failed;
+}
+
+static void add_result(diffresult* sum, const diffresult* result) {
+    sum->insertions = sum->insertions + result->insertions;
+    sum->deletions = sum->deletions + result->deletions;
+    sum->changes = sum->changes + result->changes;
+}
+
+static void run_diff(worker* w, void* arg) {
+    diffjob* job = (diffjob*)arg;
+    pipeline* p = job->p;
+    churny_ctx* ctx = p->ctx;
+    unsigned long hits = w->trees.hits;
+    unsigned long misses = w->trees.misses;
+    diffresult results[DIFF_BATCH];
+    diffresult languages[DIFF_BATCH][NUM_LANGUAGES];
+    editscript scripts[DIFF_BATCH];
+    bool diffed[DIFF_BATCH];
+    int error = 0;
+    int i;
+    int l;
+
+    for (i = 0; i < job->size; i++) {
+        diffpair* pair = &job->pairs[i];
+
+        diffed[i] = false;
+        editscript_init(&scripts[i]);
+        if (error == 0 && !failed(p)) {
+            error = calculate_cached_diff(&results[i], ctx, w->repo,
+                &w->trees, &w->scratch, &pair->prev, &pair->cur,
+                &pair->prev_tree, &pair->cur_tree, p->extension,
+                p->languages ? languages[i] : NULL,
+                p->survival || p->coupling ? &scripts[i] : NULL);
+            arena_reset(&w->scratch);
+            diffed[i] = error == 0;
+        }
+    }
+
+    /* the results of the run are merged at once */
+    pthread_mutex_lock(&p->lock);
+    for (i = 0; i < job->size; i++) {
+        diffpair* pair = &job->pairs[i];
+        diffresult* result = &results[i];
+        bucket* b = pair->b;
+
+        if (diffed[i] && pair->author < 0) {
+            /* only needed for the edit script */
+        } else if (diffed[i] && p->budget > 0) {
+            sample_add(&b->insertions, result->insertions);
+            sample_add(&b->deletions, result->deletions);
+            sample_add(&b->changes, result->changes);
+        } else if (diffed[i]) {
+            add_result(&b->diff, result);
+            add_result(&b->contributors.authors[pair->author].diff, result);
+            add_result(&p->total, result);
+            for (l = 0; p->languages && l < NUM_LANGUAGES; l++) {
+                add_result(&b->lang_diff[l], &languages[i][l]);
+            }
+        } else {
+            b->partial = true;
+        }
+        if (diffed[i] && (p->survival || p->coupling)) {
+            b->scripts[pair->index].script = scripts[i];
+        } else {
+            editscript_free(&scripts[i]);
+        }
+        if (diffed[i] && pair->author >= 0) {
+            p->counts.diffed = p->counts.diffed + 1;
+        }
+        b->pending = b->pending - 1;
+        p->pending = p->pending - 1;
+    }
+    if (error < 0 && p->error == 0) {
+        p->error = error;
+    }
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->stats.tree_hits = ctx->stats.tree_hits + w->trees.hits - hits;
+    ctx->stats.tree_misses = ctx->stats.tree_misses + w->trees.misses - misses;
+    pthread_mutex_unlock(&ctx->lock);
+
+    free(job);
+}
+
+static void run_loc(worker* w, void* arg) {
+    const char id[] = "run_loc";
+    locjob* job = (locjob*)arg;
+    pipeline* p = job->p;
+    bool skipped = failed(p);
+    estimate e;
+    span s;
+    int error = 0;
+
+    TIMELINE_BEGIN(&s, loc);
+
+    if (!skipped && job->languages != NULL) {
+        error = calculate_cached_languages(
+            job->languages, p->ctx, w->repo, &job->commit);
+    } else if (!skipped && job->sample_size > 0) {
+        error = estimate_loc(
+            &e, w->repo, &job->commit, p->extension, job->sample_size);
+        if (error < 0) {
+            set_error(p->ctx, "%s %s - Error while estimating lines of code",
+                fatal, id);
+        } else {
+            *job->loc = (int)llround(e.total);
+            *job->margin = e.margin;
+        }
+    } else if (!skipped) {
+        error = calculate_cached_loc(
+            job->loc, p->ctx, w->repo, &job->commit, p->extension);
+    }
+    TIMELINE_END(&s, loc);
+
+    finish_job(p, job->b, error, !skipped);
+    free(job);
+}
+
+static int submit(pipeline* p, bucket* b, pool* pool, task_fn fn, void* job) {
+    pthread_mutex_lock(&p->lock);
+    b->pending = b->pending + 1;
+    p->pending = p->pending + 1;
+    pthread_mutex_unlock(&p->lock);
+
+    if (pool == NULL || pool_submit(pool, fn, job) < 0) {
+        free(job);
+        finish_job(p, b, -1, false);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* the counts are kept under the lock of the pipeline */
+static void count_progress(progress_counts* out, void* payload) {
+    pipeline* p = (pipeline*)payload;
+
+    pthread_mutex_lock(&p->lock);
+    *out = p->counts;
+    pthread_mutex_unlock(&p->lock);
+}
+
+pipeline* pipeline_create(churny_ctx* ctx, const char* extension) {
+    pipeline* p = (pipeline*)calloc(1, sizeof(pipeline));
+
+    if (p == NULL) {
+        return NULL;
+    }
+
+    p->ctx = ctx;
+    p->extension = extension;
+    p->budget = ctx->sample_budget;
+    /* estimates are not broken down by language */
+    p->languages = ctx->languages && p->budget == 0;
+    /* the diffs against all parents do not form a chain */
+    p->survival = ctx->survival && p->budget == 0
+        && ctx->diff_mode != ALL_PARENTS;
+    p->coupling = ctx->coupling && p->budget == 0 && !p->languages;
+    survival_init(&p->lines);
+    p->deadline = ctx->deadline;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->changed, NULL);
+
+    if ((ctx->progress_stream != NULL || ctx->status_path != NULL)
+        && progress_start(&p->reporter, ctx->progress_stream,
+               ctx->status_path, ctx->progress_seconds, count_progress, p)
+            < 0) {
+        pthread_cond_destroy(&p->changed);
+        pthread_mutex_destroy(&p->lock);
+        free(p);
+        return NULL;
+    }
+
+    return p;
+}
+
+bucket* pipeline_open(pipeline* p) {
+    bucket* b = (bucket*)calloc(1, sizeof(bucket));
+
+    if (b == NULL) {
+        return NULL;
+    }
+    authormap_init(&b->contributors);
+    coupling_init(&b->coupled);
+
+    pthread_mutex_lock(&p->lock);
+    if (p->size == p->capacity) {
+        size_t capacity = p->capacity == 0 ? 64 : 2 * p->capacity;
+        bucket** buckets = realloc(p->buckets, capacity * sizeof(bucket*));
+        if (buckets == NULL) {
+            pthread_mutex_unlock(&p->lock);
+            authormap_destroy(&b->contributors);
+            coupling_destroy(&b->coupled);
+            free(b);
+            return NULL;
+        }
+        p->buckets = buckets;
+        p->capacity = capacity;
+    }
+    p->buckets[p->size] = b;
+    p->size = p->size + 1;
+    pthread_mutex_unlock(&p->lock);
+
+    return b;
+}
+
+/* adds a commit of the author to the interval,
+ * returns the index of the author in the bucket */
+int pipeline_commit(
+    pipeline* p, bucket* b, const char* author, git_time_t time) {
+    int index;
+
+    /* workers may be adding to the churn of the authors meanwhile */
+    pthread_mutex_lock(&p->lock);
+    index = authormap_add(&b->contributors, author);
+    if (index >= 0) {
+        b->contributors.authors[index].num_commits
+            = b->contributors.authors[index].num_commits + 1;
+    }
+    p->counts.commits = p->counts.commits + 1;
+    p->counts.current = time;
+    pthread_mutex_unlock(&p->lock);
+
+    return index;
+}
+
+/* the number of pairs to diff in total, for an estimate of the time
+ * that is left, 0 if it is not known */
+void pipeline_expect(pipeline* p, unsigned long pairs) {
+    pthread_mutex_lock(&p->lock);
+    p->counts.expected = pairs;
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* checked by the walker before each commit, once the deadline has
+ * passed, the jobs that are still queued are skipped */
+bool pipeline_expired(pipeline* p) {
+    if (p->deadline == 0 || time(NULL) < p->deadline) {
+        return false;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    p->expired = true;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+    return true;
+}
+
+/* submits the pairs collected so far */
+static int flush(pipeline* p) {
+    diffjob* job = p->batch;
+    pool* pool;
+    int i;
+
+    if (job == NULL) {
+        return 0;
+    }
+
+    p->batch = NULL;
+    TIMELINE_END(&p->walk, walk);
+    pool = churny_pool(p->ctx);
+    if (pool != NULL && pool_submit(pool, run_diff, job) == 0) {
+        return 0;
+    }
+
+    for (i = 0; i < job->size; i++) {
+        finish_job(p, job->pairs[i].b, -1, false);
+    }
+    free(job);
+    return -1;
+}
+
+/* the index of the edit script is assigned here */
+static int add_pair(pipeline* p, const diffpair* next) {
+    bucket* b = next->b;
+    diffpair* pair;
+
+    if (p->batch == NULL) {
+        p->batch = (diffjob*)malloc(sizeof(diffjob));
+        if (p->batch == NULL) {
+            return -1;
+        }
+        p->batch->p = p;
+        p->batch->size = 0;
+        TIMELINE_BEGIN(&p->walk, walk);
+    }
+
+    /* workers store the scripts of earlier pairs meanwhile */
+    pthread_mutex_lock(&p->lock);
+    if ((p->survival || p->coupling)
+        && b->num_scripts == b->scripts_capacity) {
+        size_t capacity
+            = b->scripts_capacity == 0 ? 64 : 2 * b->scripts_capacity;
+        pairscript* scripts
+            = realloc(b->scripts, capacity * sizeof(pairscript));
+        if (scripts == NULL) {
+            pthread_mutex_unlock(&p->lock);
+            return -1;
+        }
+        b->scripts = scripts;
+        b->scripts_capacity = capacity;
+    }
+
+    pair = &p->batch->pairs[p->batch->size];
+    *pair = *next;
+    pair->index = b->num_scripts;
+    p->batch->size = p->batch->size + 1;
+
+    if (p->survival || p->coupling) {
+        editscript_init(&b->scripts[pair->index].script);
+        b->scripts[pair->index].counted = pair->author >= 0;
+        b->num_scripts = b->num_scripts + 1;
+    }
+    b->pending = b->pending + 1;
+    p->pending = p->pending + 1;
+    if (pair->author >= 0) {
+        p->counts.pairs = p->counts.pairs + 1;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    if (p->batch->size == DIFF_BATCH) {
+        return flush(p);
+    }
+
+    return 0;
+}
+
+/* the diff is credited to the given author of the bucket, a pair without
+ * an author is only diffed if its edit script is needed */
+int pipeline_diff(pipeline* p, bucket* b, const git_oid* prev,
+    const git_oid* cur, const git_oid* prev_tree, const git_oid* cur_tree,
+    int author) {
+    diffpair pair;
+
+    if (author < 0 && !p->survival) {
+        return 0;
+    }
+
+    pair.b = b;
+    pair.prev = *prev;
+    pair.cur = *cur;
+    pair.prev_tree = *prev_tree;
+    pair.cur_tree = *cur_tree;
+    pair.author = author;
+    pair.index = 0;
+    if (p->budget == 0) {
+        return add_pair(p, &pair);
+    }
+
+    /* the sample is drawn once all pairs are known */
+    if (b->num_pairs == b->pairs_capacity) {
+        size_t capacity
+            = b->pairs_capacity == 0 ? 64 : 2 * b->pairs_capacity;
+        diffpair* pairs = realloc(b->pairs, capacity * sizeof(diffpair));
+        if (pairs == NULL) {
+            return -1;
+        }
+        b->pairs = pairs;
+        b->pairs_capacity = capacity;
+    }
+
+    b->pairs[b->num_pairs] = pair;
+    b->num_pairs = b->num_pairs + 1;
+    return 0;
+}
+
+/* lines of code are read from the object database, so the boundary
+ * commits of all intervals can be counted in parallel */
+static int schedule_loc(pipeline* p, bucket* b, const git_oid* commit,
+    int* loc, double* margin, size_t sample_size) {
+    locjob* job = (locjob*)malloc(sizeof(locjob));
+
+    if (job == NULL) {
+        return -1;
+    }
+
+    job->p = p;
+    job->b = b;
+    job->commit = *commit;
+    job->loc = loc;
+    job->margin = margin;
+    job->sample_size = sample_size;
+    job->languages = NULL;
+    return submit(p, b, churny_pool(p->ctx), run_loc, job);
+}
+
+static int schedule_languages(
+    pipeline* p, bucket* b, const git_oid* commit, int* languages) {
+    locjob* job = (locjob*)malloc(sizeof(locjob));
+
+    if (job == NULL) {
+        return -1;
+    }
+
+    job->p = p;
+    job->b = b;
+    job->commit = *commit;
+    job->loc = NULL;
+    job->margin = NULL;
+    job->sample_size = 0;
+    job->languages = languages;
+    return submit(p, b, churny_pool(p->ctx), run_loc, job);
+}
+
+/* pairs that are diffed for an interval at least,
+ * otherwise there would be no error bound */
+static size_t min_pairs(const bucket* b) {
+    return b->num_pairs < MIN_SAMPLE ? b->num_pairs : MIN_SAMPLE;
+}
+
+/* the part of the budget that is spent however small it is, for the
+ * rows that are reported, MIN_SAMPLE files are read for each boundary
+ * commit */
+static size_t sample_floor(size_t* num_rows, const pipeline* p) {
+    size_t minimum = 0;
+    size_t i;
+
+    *num_rows = 0;
+    for (i = 0; i < p->size; i++) {
+        if (p->buckets[i]->num_commits > 1) {
+            minimum = minimum + min_pairs(p->buckets[i]) + 2 * MIN_SAMPLE;
+            *num_rows = *num_rows + 1;
+        }
+    }
+
+    return minimum;
+}
+
+/*
+ * Splits the budget between the diffs and the files that are read for
+ * lines of code. Each interval first gets its minimum of both, which
+ * sample_floor() takes from the budget. Half of the rest goes to the
+ * diffs, in proportion to the number of commit pairs of the intervals,
+ * and half to the files, the same number for each boundary commit. So
+ * about budget diffs and blobs are read in all.
+ */
+static int sample(pipeline* p) {
+    size_t population = 0;
+    size_t num_rows;
+    size_t spare;
+    size_t diff_share;
+    size_t num_files;
+    size_t i;
+    size_t j;
+
+    p->sampled = true;
+
+    for (i = 0; i < p->size; i++) {
+        if (p->buckets[i]->num_commits > 1) {
+            population = population + p->buckets[i]->num_pairs;
+        }
+    }
+
+    spare = (size_t)p->budget - sample_floor(&num_rows, p);
+    diff_share = spare - spare / 2;
+    num_files = num_rows == 0 ? 0 : MIN_SAMPLE + spare / 2 / (2 * num_rows);
+
+    for (i = 0; i < p->size; i++) {
+        bucket* b = p->buckets[i];
+        size_t* indices;
+        size_t size;
+        unsigned int seed;
+
+        if (b->num_commits <= 1) {
+            continue;
+        }
+
+        size = min_pairs(b);
+        if (population > 0) {
+            size = size
+                + (size_t)((double)diff_share * b->num_pairs / population
+                      + 0.5);
+        }
+        if (size > b->num_pairs) {
+            size = b->num_pairs;
+        }
+        b->sample_size = size;
+
+        indices = (size_t*)malloc((b->num_pairs + 1) * sizeof(size_t));
+        if (indices == NULL) {
+            return -1;
+        }
+
+        /* the same history always gets the same sample */
+        memcpy(&seed, b->first.id, sizeof(seed));
+        sample_indices(indices, b->num_pairs, size, &seed);
+
+        for (j = 0; j < size; j++) {
+            if (add_pair(p, &b->pairs[indices[j]]) < 0) {
+                free(indices);
+                return -1;
+            }
+        }
+        free(indices);
+
+        if (schedule_loc(p, b, &b->first, &b->first_loc,
+                &b->margin.first_loc, num_files)
+                < 0
+            || schedule_loc(p, b, &b->last, &b->last_loc,
+                   &b->margin.last_loc, num_files)
+                < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int pipeline_close(pipeline* p, bucket* b, const git_oid* first,
+    git_time_t first_time, const git_oid* last, git_time_t last_time,
+    int num_commits) {
+    int error = 0;
+
+    b->first = *first;
+    b->last = *last;
+    b->first_time = first_time;
+    b->last_time = last_time;
+    b->num_commits = num_commits;
+
+    /* the walk stopped at the deadline, somewhere in the interval,
+     * and its lines of code would not be counted anymore */
+    if (p->expired) {
+        pthread_mutex_lock(&p->lock);
+        b->partial = true;
+        b->closed = true;
+        pthread_cond_broadcast(&p->changed);
+        pthread_mutex_unlock(&p->lock);
+        return 0;
+    }
+
+    /* intervals with less than two commits are not reported */
+    if (num_commits > 1 && p->languages) {
+        if ((error = schedule_languages(p, b, first, b->lang_first_loc))
+            == 0) {
+            error = schedule_languages(p, b, last, b->lang_last_loc);
+        }
+    } else if (num_commits > 1 && p->budget == 0) {
+        if ((error = schedule_loc(p, b, first, &b->first_loc, NULL, 0))
+            == 0) {
+            error = schedule_loc(p, b, last, &b->last_loc, NULL, 0);
+        }
+    }
+
+    pthread_mutex_lock(&p->lock);
+    b->closed = true;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+
+    return error;
+}
+
+/* expands the sampled diffs of a bucket, must be called with p->lock held */
+static void expand_sample(pipeline* p, bucket* b, churnrow* row) {
+    estimate e;
+
+    e = sample_estimate(&b->insertions, b->num_pairs, b->sample_size);
+    row->diff.insertions = (unsigned long)llround(e.total);
+    row->margin.insertions = e.margin;
+    e = sample_estimate(&b->deletions, b->num_pairs, b->sample_size);
+    row->diff.deletions = (unsigned long)llround(e.total);
+    row->margin.deletions = e.margin;
+    e = sample_estimate(&b->changes, b->num_pairs, b->sample_size);
+    row->diff.changes = (unsigned long)llround(e.total);
+    row->margin.changes = e.margin;
+    row->margin.first_loc = b->margin.first_loc;
+    row->margin.last_loc = b->margin.last_loc;
+
+    p->total.insertions = p->total.insertions + row->diff.insertions;
+    p->total.deletions = p->total.deletions + row->diff.deletions;
+    p->total.changes = p->total.changes + row->diff.changes;
+}
+
+/* runs the callback on a row, must be called with p->lock held,
+ * which is released meanwhile and not taken again if the callback fails */
+static int report(
+    pipeline* p, churnrow* row, churny_row_cb cb, void* payload) {
+    const char id[] = "pipeline_emit";
+    span s;
+    int error;
+
+    calculate_ratios(row);
+    p->counts.rows = p->counts.rows + 1;
+
+    /* the callback must not be run while holding the lock */
+    pthread_mutex_unlock(&p->lock);
+    TIMELINE_BEGIN(&s, emit);
+    error = cb(row, payload);
+    TIMELINE_END(&s, emit);
+    if (error != 0) {
+        set_error(
+            p->ctx, "%s %s - Aborted by callback (%d)", fatal, id, error);
+        return error;
+    }
+    pthread_mutex_lock(&p->lock);
+
+    return 0;
+}
+
+/* applies the edit scripts of a bucket to the lines that survive and
+ * counts the files changed together, then frees them, the scripts are
+ * not touched by the workers anymore */
+static int apply_scripts(pipeline* p, bucket* b, unsigned long* surviving) {
+    size_t i;
+    int error = 0;
+
+    *surviving = 0;
+    for (i = 0; i < b->num_scripts; i++) {
+        pairscript* s = &b->scripts[i];
+        if (error == 0 && p->survival) {
+            error = survival_apply(&p->lines, &s->script,
+                s->counted ? surviving : NULL,
+                s->counted && p->languages ? b->lang_surviving : NULL);
+        }
+        if (error == 0 && p->coupling && s->counted) {
+            error = coupling_add(&b->coupled, &s->script);
+        }
+        editscript_free(&s->script);
+    }
+    b->num_scripts = 0;
+
+    return error;
+}
+
+/* waits for a job to finish, must be called with p->lock held,
+ * no longer than until the deadline */
+static void wait_for_jobs(pipeline* p) {
+    struct timespec deadline;
+
+    if (p->deadline == 0 || p->expired) {
+        pthread_cond_wait(&p->changed, &p->lock);
+        return;
+    }
+
+    deadline.tv_sec = p->deadline;
+    deadline.tv_nsec = 0;
+    if (pthread_cond_timedwait(&p->changed, &p->lock, &deadline)
+        == ETIMEDOUT) {
+        p->expired = true;
+    }
+}
+
+/* emits the finished buckets in order, waits for all buckets if asked to */
+int pipeline_emit(pipeline* p, churny_row_cb cb, void* payload, bool wait) {
+    const char id[] = "pipeline_emit";
+    unsigned long surviving = 0;
+    coupledpair* top = NULL;
+    size_t num_top = 0;
+    size_t num_rows;
+    size_t minimum;
+    int error = 0;
+    int l;
+
+    /* nothing can be reported before the sample is drawn */
+    if (p->budget > 0 && !p->sampled) {
+        if (!wait) {
+            return 0;
+        }
+        /* the walk is done, but no diff has been started yet */
+        if ((minimum = sample_floor(&num_rows, p)) > (size_t)p->budget) {
+            p->sampled = true;
+            p->error = set_error(p->ctx,
+                "%s %s - A sample budget of at least %zu is needed for %zu "
+                "rows",
+                fatal, id, minimum, num_rows);
+            return p->error;
+        }
+        if (sample(p) < 0) {
+            flush(p);
+            return set_error(
+                p->ctx, "%s %s - Could not schedule jobs", fatal, id);
+        }
+    }
+
+    /* pairs that are still collected would never be finished */
+    if (wait && flush(p) < 0) {
+        return set_error(
+            p->ctx, "%s %s - Could not schedule jobs", fatal, id);
+    }
+
+    pthread_mutex_lock(&p->lock);
+
+    while (p->error == 0 && !p->truncated && p->next < p->size) {
+        bucket* b = p->buckets[p->next];
+
+        if (!b->closed || b->pending > 0) {
+            if (!wait) {
+                break;
+            }
+            wait_for_jobs(p);
+            continue;
+        }
+
+        p->next = p->next + 1;
+
+        /* the scripts of every bucket are needed for the ones after it,
+         * they are applied without the lock, only this thread emits */
+        if (p->survival || p->coupling) {
+            pthread_mutex_unlock(&p->lock);
+            error = apply_scripts(p, b, &surviving);
+            pthread_mutex_lock(&p->lock);
+            if (error < 0) {
+                p->error = set_error(
+                    p->ctx, "%s %s - Out of memory", fatal, id);
+                break;
+            }
+        }
+
+        if (b->num_commits > 1) {
+            churnrow row;
+            row.first = b->first;
+            row.last = b->last;
+            row.first_time = b->first_time;
+            row.last_time = b->last_time;
+            row.num_commits = b->num_commits;
+            row.num_authors = (int)b->contributors.size;
+            row.diff = b->diff;
+            row.first_loc = b->first_loc;
+            row.last_loc = b->last_loc;
+            row.approximate = p->budget > 0;
+            memset(&row.margin, 0, sizeof(churnmargin));
+            row.sketched = p->ctx->author_sketches;
+            row.authors = b->authors;
+            row.author_churn = NULL;
+            row.language = -1;
+            row.partial = b->partial;
+            row.surviving = surviving;
+            row.coupling = NULL;
+            row.num_coupling = 0;
+            if (p->coupling) {
+                if (coupling_top(&top, &num_top, &b->coupled, COUPLING_TOP)
+                    < 0) {
+                    p->error = set_error(
+                        p->ctx, "%s %s - Out of memory", fatal, id);
+                    break;
+                }
+                row.coupling = top;
+                row.num_coupling = num_top;
+            }
+            if (row.approximate) {
+                expand_sample(p, b, &row);
+            } else if (p->ctx->author_churn) {
+                authormap_sort(&b->contributors);
+                row.author_churn = b->contributors.authors;
+            }
+
+            error = p->languages ? 0 : report(p, &row, cb, payload);
+            free(top);
+            top = NULL;
+            if (error != 0) {
+                return error;
+            }
+
+            /* languages that do not occur in the interval are left out */
+            for (l = 0; p->languages && l < NUM_LANGUAGES; l++) {
+                if (b->lang_diff[l].changes == 0 && b->lang_first_loc[l] == 0
+                    && b->lang_last_loc[l] == 0) {
+                    continue;
+                }
+                row.language = l;
+                row.diff = b->lang_diff[l];
+                row.first_loc = b->lang_first_loc[l];
+                row.last_loc = b->lang_last_loc[l];
+                row.surviving = b->lang_surviving[l];
+                if ((error = report(p, &row, cb, payload)) != 0) {
+                    return error;
+                }
+            }
+        }
+
+        /* nobody refers to the authors of an emitted bucket anymore */
+        authormap_destroy(&b->contributors);
+        coupling_destroy(&b->coupled);
+
+        /* the following buckets could only be partial as well */
+        p->truncated = b->partial;
+    }
+
+    error = p->error;
+    pthread_mutex_unlock(&p->lock);
+    return error;
+}
+
+/* waits for outstanding jobs, they still refer to the pipeline */
+void pipeline_destroy(pipeline* p) {
+    size_t i;
+
+    if (p->batch != NULL) {
+        for (i = 0; i < (size_t)p->batch->size; i++) {
+            finish_job(p, p->batch->pairs[i].b, 0, false);
+        }
+        free(p->batch);
+    }
+
+    pthread_mutex_lock(&p->lock);
+    while (p->pending > 0) {
+        pthread_cond_wait(&p->changed, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    progress_stop(&p->reporter, p->truncated ? "expired"
+            : p->next == p->size             ? "done"
+                                             : "failed");
+
+    for (i = 0; i < p->size; i++) {
+        bucket* b = p->buckets[i];
+        size_t j;
+        authormap_destroy(&b->contributors);
+        coupling_destroy(&b->coupled);
+        for (j = 0; j < b->num_scripts; j++) {
+            editscript_free(&b->scripts[j].script);
+        }
+        free(b->scripts);
+        free(b->pairs);
+        free(b);
+    }
+    free(p->buckets);
+    survival_destroy(&p->lines);
+    pthread_cond_destroy(&p->changed);
+    pthread_mutex_destroy(&p->lock);
+    free(p);
+}
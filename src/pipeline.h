@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+#ifndef PIPELINE_H_ /* Include guard */
+#define PIPELINE_H_
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <git2.h>
+#include "churny.h"
+#include "sample.h"
+#include "progress.h"
+#include "coupling.h"
+
+/* number of adjacent commit pairs that are diffed by the same worker */
+#define DIFF_BATCH 32
+
+/* commit pairs diffed and files read per interval in approximate mode
+ * at least, fewer give no error bound */
+#define MIN_SAMPLE 2
+
+/*
+ * The revision walker opens a bucket per interval and schedules the
+ * diffs of its commit pairs on the worker pool. Once the walker has
+ * left the interval, it closes the bucket, which schedules counting the
+ * lines of code of its boundary commits. Buckets are emitted as rows in
+ * the order they were opened, as soon as all of their jobs are done.
+ *
+ * The authors of an interval and the churn of each of them are kept in
+ * its bucket. Each worker sums up the results of a run of pairs by
+ * itself and merges them into the buckets once the run is done, so the
+ * pipeline is locked once per run instead of once per pair.
+ *
+ * Commit pairs are handed to the workers in runs of adjacent history.
+ * Adjacent pairs share their commits, and their objects are close to
+ * each other in the packfile, so a worker can reuse the trees and
+ * delta bases it has just resolved.
+ *
+ * With languages, the changes of each diff and the lines of code of the
+ * boundary commits are also counted per language, and a bucket is
+ * emitted as a row per language.
+ *
+ * With survival, each diff is recorded as an edit script in its slot of
+ * the bucket. The scripts are applied in the order of the walk while the
+ * buckets are emitted, from HEAD backwards, which needs a chain of pairs.
+ * Pairs without an author are only diffed to complete the chain, their
+ * churn and surviving lines are not counted.
+ *
+ * With coupling, the edit script of each diff is kept in its slot as
+ * well. When the bucket is emitted, the files changed by each counted
+ * diff are taken from its script, and the pairs of them are counted.
+ * So the workers only store their scripts under the lock.
+ *
+ * With a deadline, the walker stops once it has passed, and jobs that
+ * are still queued are skipped. Buckets that are complete are emitted
+ * as before, the first one that is not is emitted as a partial row, and
+ * nothing after it.
+ *
+ * In approximate mode, the pairs are only collected while walking.
+ * When the walk is done, each interval is a stratum that gets its share
+ * of the sample budget, and only the sampled pairs are diffed. Lines of
+ * code are estimated from a sample of files of the boundary commits,
+ * which are paid from the same budget.
+ */
+typedef struct bucket bucket;
+
+typedef struct {
+    bucket* b;
+    git_oid prev;
+    git_oid cur;
+    git_oid prev_tree; /* from the commit graph, so no commit is parsed */
+    git_oid cur_tree;
+    int author; /* index into the authors of the bucket, -1 if not counted */
+    size_t index; /* of the edit script in the bucket */
+} diffpair;
+
+typedef struct {
+    editscript script;
+    bool counted; /* the surviving lines are credited to the bucket */
+} pairscript;
+
+struct bucket {
+    git_oid first;
+    git_oid last;
+    git_time_t first_time;
+    git_time_t last_time;
+    int num_commits;
+    diffresult diff;
+    int first_loc;
+    int last_loc;
+    int pending;
+    bool closed;
+    bool partial; /* the deadline passed before all of it was analyzed */
+    /* approximate mode */
+    diffpair* pairs;
+    size_t num_pairs;
+    size_t pairs_capacity;
+    size_t sample_size;
+    samplesum insertions;
+    samplesum deletions;
+    samplesum changes;
+    churnmargin margin;
+    hll authors;
+    authormap contributors; /* guarded by the lock of the pipeline */
+    coupling coupled;       /* only used by the thread that emits */
+    /* one row per language */
+    diffresult lang_diff[NUM_LANGUAGES];
+    int lang_first_loc[NUM_LANGUAGES];
+    int lang_last_loc[NUM_LANGUAGES];
+    /* survival, one edit script per pair in the order of the walk */
+    pairscript* scripts;
+    size_t num_scripts;
+    size_t scripts_capacity;
+    unsigned long lang_surviving[NUM_LANGUAGES];
+};
+
+typedef struct diffjob diffjob;
+
+typedef struct {
+    churny_ctx* ctx;
+    const char* extension;
+    int budget;
+    bool sampled;
+    bool languages;
+    bool survival;
+    survival lines; /* only used by the thread that emits */
+    bool coupling;
+    diffjob* batch;
+    span walk; /* while the pairs of the batch are collected */
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    bucket** buckets;
+    size_t size;
+    size_t capacity;
+    size_t next;
+    int pending;
+    diffresult total;
+    int error;
+    time_t deadline; /* 0 if there is none */
+    bool expired;
+    bool truncated; /* a partial row was emitted, nothing follows */
+    progress_counts counts;
+    progress reporter;
+} pipeline;
+
+pipeline* pipeline_create(churny_ctx* ctx, const char* extension);
+
+bucket* pipeline_open(pipeline* p);
+
+int pipeline_commit(
+    pipeline* p, bucket* b, const char* author, git_time_t time);
+
+void pipeline_expect(pipeline* p, unsigned long pairs);
+
+bool pipeline_expired(pipeline* p);
+
+int pipeline_diff(pipeline* p, bucket* b, const git_oid* prev,
+    const git_oid* cur, const git_oid* prev_tree, const git_oid* cur_tree,
+    int author);
+
+int pipeline_close(pipeline* p, bucket* b, const git_oid* first,
+    git_time_t first_time, const git_oid* last, git_time_t last_time,
+    int num_commits);
+
+int pipeline_emit(pipeline* p, churny_row_cb cb, void* payload, bool wait);
+
+void pipeline_destroy(pipeline* p);
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+#include "pool.h"
+
+static void* run_worker(void* arg) {
+    worker* w = (worker*)arg;
+    task* t;
+
+    while ((t = (task*)queue_pop(w->pool->tasks)) != NULL) {
+        t->fn(w, t->arg);
+        free(t);
+    }
+
+    return NULL;
+}
+
+pool* pool_create(const char* path, int num_workers) {
+    pool* p = (pool*)calloc(1, sizeof(pool));
+    int i;
+
+    if (p == NULL) {
+        return NULL;
+    }
+
+    p->workers = (worker*)calloc(num_workers, sizeof(worker));
+    /* a few tasks per worker are enough to keep everybody busy */
+    p->tasks = queue_create(4 * num_workers);
+    if (p->workers == NULL || p->tasks == NULL) {
+        pool_destroy(p);
+        return NULL;
+    }
+
+    for (i = 0; i < num_workers; i++) {
+        worker* w = &p->workers[i];
+        w->index = i;
+        w->pool = p;
+        treecache_init(&w->trees);
+        arena_init(&w->scratch);
+
+        if (git_repository_open(&w->repo, path) < 0
+            || pthread_create(&w->thread, NULL, run_worker, w) != 0) {
+            git_repository_free(w->repo);
+            w->repo = NULL;
+            pool_destroy(p);
+            return NULL;
+        }
+
+        p->num_workers = i + 1;
+    }
+
+    return p;
+}
+
+/* blocks while the queue is full */
+int pool_submit(pool* p, task_fn fn, void* arg) {
+    task* t = (task*)malloc(sizeof(task));
+
+    if (t == NULL) {
+        return -1;
+    }
+
+    t->fn = fn;
+    t->arg = arg;
+
+    if (queue_push(p->tasks, t) < 0) {
+        free(t);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* waits until all submitted tasks are done */
+void pool_destroy(pool* p) {
+    int i;
+
+    if (p->tasks != NULL) {
+        queue_close(p->tasks);
+    }
+
+    for (i = 0; i < p->num_workers; i++) {
+        pthread_join(p->workers[i].thread, NULL);
+        treecache_clear(&p->workers[i].trees);
+        arena_destroy(&p->workers[i].scratch);
+        git_repository_free(p->workers[i].repo);
+    }
+
+    if (p->tasks != NULL) {
+        queue_destroy(p->tasks);
+    }
+    free(p->workers);
+    free(p);
+}
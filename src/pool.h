@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+#ifndef POOL_H_ /* Include guard */
+#define POOL_H_
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <git2.h>
+#include "queue.h"
+#include "treecache.h"
+#include "arena.h"
+
+struct pool;
+
+/* libgit2 objects must not be shared between threads,
+ * so every worker has its own repository */
+typedef struct {
+    pthread_t thread;
+    git_repository* repo;
+    treecache trees;
+    arena scratch; /* temporaries of the current task */
+    int index;
+    struct pool* pool;
+} worker;
+
+typedef void (*task_fn)(worker* worker, void* arg);
+
+typedef struct {
+    task_fn fn;
+    void* arg;
+} task;
+
+typedef struct pool {
+    worker* workers;
+    int num_workers;
+    queue* tasks;
+} pool;
+
+pool* pool_create(const char* path, int num_workers);
+
+int pool_submit(pool* pool, task_fn fn, void* arg);
+
+void pool_destroy(pool* pool);
+
+#endif
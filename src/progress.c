@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#include "progress.h"
+
+/* seconds until all expected pairs are diffed at the rate so far,
+ * -1 if that cannot be told */
+static long eta(const progress_counts* counts, time_t elapsed) {
+    if (counts->expected == 0 || counts->diffed == 0) {
+        return -1;
+    }
+    if (counts->diffed >= counts->expected) {
+        return 0;
+    }
+    return (long)((double)elapsed * (counts->expected - counts->diffed)
+        / counts->diffed);
+}
+
+static void print_line(FILE* stream, const progress_counts* counts,
+    time_t elapsed, const char* state) {
+    char current[16] = "-";
+    time_t t = counts->current;
+    long seconds = eta(counts, elapsed);
+    struct tm tm;
+
+    /* the walker may be formatting dates meanwhile */
+    if (counts->current != 0) {
+        strftime(current, sizeof(current), "%F", gmtime_r(&t, &tm));
+    }
+
+    fprintf(stream, "churny: %lds %s, %lu commits walked (at %s), "
+                    "%lu/%lu pairs diffed, %lu rows",
+        (long)elapsed, state, counts->commits, current, counts->diffed,
+        counts->pairs, counts->rows);
+    if (seconds >= 0 && !strcmp(state, "running")) {
+        fprintf(stream, ", ETA %ldm%02lds", seconds / 60, seconds % 60);
+    }
+    fprintf(stream, "\n");
+    fflush(stream);
+}
+
+/* the file is replaced atomically, so readers never see half of it */
+static int write_status(const char* path, const progress_counts* counts,
+    time_t elapsed, const char* state) {
+    char tmp[strlen(path) + 5];
+    char current[16] = "";
+    time_t t = counts->current;
+    struct tm tm;
+    FILE* fp;
+    int error = 0;
+
+    if (counts->current != 0) {
+        strftime(current, sizeof(current), "%F", gmtime_r(&t, &tm));
+    }
+
+    strcpy(tmp, path);
+    strcat(tmp, ".tmp");
+
+    if ((fp = fopen(tmp, "w")) == NULL) {
+        return -1;
+    }
+
+    if (fprintf(fp, "state=%s\nelapsed=%ld\ncommits=%lu\ncurrent=%s\n"
+                    "pairs=%lu\ndiffed=%lu\nexpected=%lu\nrows=%lu\n"
+                    "eta=%ld\n",
+            state, (long)elapsed, counts->commits, current, counts->pairs,
+            counts->diffed, counts->expected, counts->rows,
+            eta(counts, elapsed))
+        < 0) {
+        error = -1;
+    }
+
+    if (fclose(fp) != 0 || error < 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void publish(progress* pr, const char* state) {
+    progress_counts counts;
+    time_t elapsed = time(NULL) - pr->start;
+
+    pr->fn(&counts, pr->payload);
+    if (pr->stream != NULL) {
+        print_line(pr->stream, &counts, elapsed, state);
+    }
+    /* a failed report is not worth failing the analysis for */
+    if (pr->path != NULL) {
+        write_status(pr->path, &counts, elapsed, state);
+    }
+}
+
+static void* run_reporter(void* arg) {
+    progress* pr = (progress*)arg;
+    struct timespec next;
+
+    pthread_mutex_lock(&pr->lock);
+    clock_gettime(CLOCK_REALTIME, &next);
+    while (!pr->stop) {
+        next.tv_sec = next.tv_sec + pr->seconds;
+        while (!pr->stop
+            && pthread_cond_timedwait(&pr->stopped, &pr->lock, &next)
+                != ETIMEDOUT) {
+        }
+        if (!pr->stop) {
+            /* the counts have a lock of their own */
+            pthread_mutex_unlock(&pr->lock);
+            publish(pr, "running");
+            pthread_mutex_lock(&pr->lock);
+        }
+    }
+    pthread_mutex_unlock(&pr->lock);
+
+    return NULL;
+}
+
+int progress_start(progress* pr, FILE* stream, const char* path,
+    int seconds, progress_fn fn, void* payload) {
+    memset(pr, 0, sizeof(progress));
+    pr->stream = stream;
+    pr->path = path;
+    pr->seconds = seconds > 0 ? seconds : PROGRESS_SECONDS;
+    pr->fn = fn;
+    pr->payload = payload;
+    pr->start = time(NULL);
+    pthread_mutex_init(&pr->lock, NULL);
+    pthread_cond_init(&pr->stopped, NULL);
+
+    if (pthread_create(&pr->thread, NULL, run_reporter, pr) != 0) {
+        pthread_cond_destroy(&pr->stopped);
+        pthread_mutex_destroy(&pr->lock);
+        return -1;
+    }
+
+    pr->running = true;
+    return 0;
+}
+
+void progress_stop(progress* pr, const char* state) {
+    if (!pr->running) {
+        return;
+    }
+
+    pthread_mutex_lock(&pr->lock);
+    pr->stop = true;
+    pthread_cond_signal(&pr->stopped);
+    pthread_mutex_unlock(&pr->lock);
+    pthread_join(pr->thread, NULL);
+    pr->running = false;
+
+    publish(pr, state);
+    pthread_cond_destroy(&pr->stopped);
+    pthread_mutex_destroy(&pr->lock);
+}
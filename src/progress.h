@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#ifndef PROGRESS_H_ /* Include guard */
+#define PROGRESS_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <git2.h>
+
+/*
+ * Progress of a running analysis.
+ *
+ * The counters are kept by whoever does the work, under a lock that is
+ * taken anyway, and are only copied by a reporter thread every few
+ * seconds. The reporter prints a line to a stream, e.g., stderr, and/or
+ * replaces a status file of key=value lines atomically, so that a job
+ * scheduler can poll it. A final report is published when the reporter
+ * is stopped.
+ */
+
+/* default number of seconds between two reports */
+#define PROGRESS_SECONDS 5
+
+typedef struct {
+    unsigned long commits;  /* walked */
+    unsigned long pairs;    /* commit pairs scheduled for diffing */
+    unsigned long diffed;   /* commit pairs diffed */
+    unsigned long expected; /* commit pairs to diff in total, 0 if unknown */
+    unsigned long rows;     /* reported */
+    git_time_t current;     /* commit time of the last walked commit */
+} progress_counts;
+
+/* copies the current counts */
+typedef void (*progress_fn)(progress_counts* out, void* payload);
+
+typedef struct {
+    FILE* stream;     /* NULL if no lines are printed */
+    const char* path; /* of the status file, NULL if there is none */
+    int seconds;
+    progress_fn fn;
+    void* payload;
+    time_t start;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t stopped;
+    bool running;
+    bool stop;
+} progress;
+
+int progress_start(progress* pr, FILE* stream, const char* path,
+    int seconds, progress_fn fn, void* payload);
+
+/* state is written to the status file, e.g., "done" or "expired" */
+void progress_stop(progress* pr, const char* state);
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+#include "queue.h"
+
+queue* queue_create(size_t capacity) {
+    queue* q = (queue*)malloc(sizeof(queue));
+    if (q == NULL) {
+        return NULL;
+    }
+
+    q->items = (void**)malloc(capacity * sizeof(void*));
+    if (q->items == NULL) {
+        free(q);
+        return NULL;
+    }
+
+    q->capacity = capacity;
+    q->head = 0;
+    q->size = 0;
+    q->closed = false;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    return q;
+}
+
+int queue_push(queue* q, void* item) {
+    pthread_mutex_lock(&q->lock);
+
+    while (q->size == q->capacity && !q->closed) {
+        pthread_cond_wait(&q->not_full, &q->lock);
+    }
+
+    if (q->closed) {
+        pthread_mutex_unlock(&q->lock);
+        return -1;
+    }
+
+    q->items[(q->head + q->size) % q->capacity] = item;
+    q->size = q->size + 1;
+
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+/* returns NULL once the queue is closed and drained */
+void* queue_pop(queue* q) {
+    void* item = NULL;
+
+    pthread_mutex_lock(&q->lock);
+
+    while (q->size == 0 && !q->closed) {
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    }
+
+    if (q->size > 0) {
+        item = q->items[q->head];
+        q->head = (q->head + 1) % q->capacity;
+        q->size = q->size - 1;
+        pthread_cond_signal(&q->not_full);
+    }
+
+    pthread_mutex_unlock(&q->lock);
+    return item;
+}
+
+void queue_close(queue* q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = true;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void queue_destroy(queue* q) {
+    pthread_cond_destroy(&q->not_full);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_mutex_destroy(&q->lock);
+    free(q->items);
+    free(q);
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+#ifndef QUEUE_H_ /* Include guard */
+#define QUEUE_H_
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/* bounded blocking queue, producers wait while it is full */
+typedef struct {
+    void** items;
+    size_t capacity;
+    size_t head;
+    size_t size;
+    bool closed;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} queue;
+
+queue* queue_create(size_t capacity);
+
+int queue_push(queue* queue, void* item);
+
+void* queue_pop(queue* queue);
+
+void queue_close(queue* queue);
+
+void queue_destroy(queue* queue);
+
+#endif
@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#include "renames.h"
+
+static bool matches(const char* path, const char* extension) {
+    size_t length = strlen(extension);
+    return length == 0
+        || (strlen(path) > length
+               && !strcmp(path + strlen(path) - length, extension));
+}
+
+/*
+ * Records a file in the edit script, either path may be NULL. A file
+ * that no longer matches the extension is recorded as deleted, since
+ * its lines do not survive as counted lines. Returns 1 if the hunks of
+ * the file have to be added, too.
+ */
+static int record(editscript* script, const char* old_path,
+    const char* new_path, const char* extension) {
+    if (new_path != NULL && matches(new_path, extension)) {
+        return editscript_add_file(script, old_path, new_path) < 0 ? -1 : 1;
+    }
+    if (old_path != NULL && matches(old_path, extension)) {
+        return editscript_add_file(script, old_path, NULL);
+    }
+    return 0;
+}
+
+/* languages may be NULL, the changes of a file that belongs to one
+ * of the languages are also added there, script may be NULL as well */
+static int add_delta(diffresult* out, git_diff* diff, size_t idx,
+    const char* extension, diffresult* languages, editscript* script) {
+    const git_diff_delta* delta = git_diff_get_delta(diff, idx);
+    int language = languages != NULL ? language_of(delta->new_file.path) : -1;
+    git_patch* patch = NULL;
+    size_t context;
+    size_t additions;
+    size_t deletions;
+    int recorded = 0;
+    int error = 0;
+
+    if (script != NULL
+        && (recorded = record(script,
+                delta->status == GIT_DELTA_ADDED ? NULL : delta->old_file.path,
+                delta->status == GIT_DELTA_DELETED ? NULL
+                                                   : delta->new_file.path,
+                extension))
+            < 0) {
+        return -1;
+    }
+
+    if (!matches(delta->new_file.path, extension) && language < 0
+        && recorded == 0) {
+        return 0;
+    }
+
+    if (git_patch_from_diff(&patch, diff, idx) < 0) {
+        return -1;
+    }
+
+    if (patch != NULL) {
+        if (recorded == 1) {
+            error = editscript_add_patch(script, patch);
+        }
+        git_patch_line_stats(&context, &additions, &deletions, patch);
+        if (matches(delta->new_file.path, extension)) {
+            out->insertions = out->insertions + additions;
+            out->deletions = out->deletions + deletions;
+        }
+        if (language >= 0) {
+            languages[language].insertions
+                = languages[language].insertions + additions;
+            languages[language].deletions
+                = languages[language].deletions + deletions;
+        }
+        git_patch_free(patch);
+    }
+
+    return error;
+}
+
+/* counts the changed lines of each file, the same as git's diff stats,
+ * while recording the hunks in the script */
+int diff_files(diffresult* out, git_diff* diff, const char* extension,
+    diffresult* languages, editscript* script) {
+    size_t i;
+    int error = 0;
+
+    for (i = 0; error == 0 && i < git_diff_num_deltas(diff); i++) {
+        error = add_delta(out, diff, i, extension, languages, script);
+    }
+
+    return error;
+}
+
+static void count(oidmap* map, const git_oid* oid, intptr_t n) {
+    void* value = NULL;
+    oidmap_get(map, oid, &value);
+    oidmap_set(map, oid, (void*)((intptr_t)value + n));
+}
+
+static bool take(oidmap* map, const git_oid* oid) {
+    void* value;
+    if (!oidmap_get(map, oid, &value) || (intptr_t)value == 0) {
+        return false;
+    }
+    oidmap_set(map, oid, (void*)((intptr_t)value - 1));
+    return true;
+}
+
+/* scores the leftovers for similarity on a diff restricted to them */
+static int diff_similar(diffresult* out, git_repository* repo,
+    git_tree* old_tree, git_tree* new_tree, const char* extension,
+    const renameopts* opts, char** paths, size_t num_paths,
+    size_t num_sources, diffresult* languages, editscript* script) {
+    git_diff_options diff_opts = GIT_DIFF_OPTIONS_INIT;
+    git_diff_find_options find_opts = GIT_DIFF_FIND_OPTIONS_INIT;
+    git_diff* diff = NULL;
+    size_t i;
+    int error;
+
+    diff_opts.flags = GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+    diff_opts.pathspec.strings = paths;
+    diff_opts.pathspec.count = num_paths;
+    /* hunks of edit scripts have no context */
+    if (script != NULL) {
+        diff_opts.context_lines = 0;
+        diff_opts.interhunk_lines = 0;
+    }
+
+    find_opts.flags = GIT_DIFF_FIND_RENAMES;
+    if (opts->mode == COPIES) {
+        find_opts.flags = find_opts.flags | GIT_DIFF_FIND_COPIES;
+    }
+    /* the limit was checked already, do not let libgit2 cut it short */
+    find_opts.rename_limit = num_sources;
+
+    if ((error = git_diff_tree_to_tree(
+             &diff, repo, old_tree, new_tree, &diff_opts))
+            < 0
+        || (error = git_diff_find_similar(diff, &find_opts)) < 0) {
+        git_diff_free(diff);
+        return error;
+    }
+
+    for (i = 0; i < git_diff_num_deltas(diff); i++) {
+        if ((error = add_delta(out, diff, i, extension, languages, script))
+            < 0) {
+            break;
+        }
+    }
+
+    git_diff_free(diff);
+    return error;
+}
+
+/*
+ * Counts the changed lines of a diff with rename (and copy) detection.
+ *
+ * Files that were moved or copied without changes have the same blob id
+ * on both sides, so they are paired in linear time with a hash map and
+ * count as unchanged. Only the files that are left over are scored for
+ * similarity by libgit2, and only if the number of candidate pairs is
+ * within opts->limit. Otherwise, they count as deleted and added.
+ *
+ * If script is not NULL, the files are also recorded there, the paired
+ * ones as moved without hunks.
+ */
+int diff_with_renames(diffresult* out, git_repository* repo, arena* scratch,
+    git_diff* diff, git_tree* old_tree, git_tree* new_tree,
+    const char* extension, const renameopts* opts, diffresult* languages,
+    editscript* script) {
+    size_t num_deltas = git_diff_num_deltas(diff);
+    oidmap* deleted = oidmap_create(); /* blob id -> unpaired deletions */
+    oidmap* renamed = oidmap_create(); /* blob id -> paired deletions */
+    /* blob ids that can be copied -> index of a delta with them + 1 */
+    oidmap* sources = oidmap_create();
+    bool* paired = (bool*)arena_calloc(scratch, num_deltas + 1, sizeof(bool));
+    bool* leftover
+        = (bool*)arena_calloc(scratch, num_deltas + 1, sizeof(bool));
+    char** paths
+        = (char**)arena_alloc(scratch, (num_deltas + 1) * sizeof(char*));
+    size_t num_paths = 0;
+    size_t num_sources = 0;
+    size_t num_targets = 0;
+    void* value;
+    size_t i;
+    int error = 0;
+
+    if (deleted == NULL || renamed == NULL || sources == NULL
+        || paired == NULL || leftover == NULL || paths == NULL) {
+        error = -1;
+        goto cleanup;
+    }
+
+    for (i = 0; i < num_deltas; i++) {
+        const git_diff_delta* delta = git_diff_get_delta(diff, i);
+        if (delta->status == GIT_DELTA_DELETED) {
+            count(deleted, &delta->old_file.id, 1);
+            oidmap_set(sources, &delta->old_file.id, (void*)(intptr_t)(i + 1));
+        } else if (delta->status == GIT_DELTA_MODIFIED
+            && opts->mode == COPIES
+            && !oidmap_get(sources, &delta->old_file.id, &value)) {
+            oidmap_set(sources, &delta->old_file.id, (void*)(intptr_t)(i + 1));
+        }
+    }
+
+    /* exact renames and copies */
+    for (i = 0; i < num_deltas; i++) {
+        const git_diff_delta* delta = git_diff_get_delta(diff, i);
+        if (delta->status != GIT_DELTA_ADDED) {
+            continue;
+        }
+        if (take(deleted, &delta->new_file.id)) {
+            count(renamed, &delta->new_file.id, 1);
+            paired[i] = true;
+        } else if (opts->mode == COPIES
+            && oidmap_get(sources, &delta->new_file.id, &value)) {
+            paired[i] = true;
+        }
+
+        /* the lines move from a file with the same blob */
+        if (paired[i] && script != NULL
+            && oidmap_get(sources, &delta->new_file.id, &value)
+            && record(script,
+                   git_diff_get_delta(diff, (intptr_t)value - 1)->old_file.path,
+                   delta->new_file.path, extension)
+                < 0) {
+            error = -1;
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < num_deltas; i++) {
+        const git_diff_delta* delta = git_diff_get_delta(diff, i);
+        if (delta->status == GIT_DELTA_DELETED
+            && take(renamed, &delta->old_file.id)) {
+            paired[i] = true;
+        }
+    }
+
+    /* the leftovers, modified files are only needed as copy sources */
+    for (i = 0; i < num_deltas; i++) {
+        const git_diff_delta* delta = git_diff_get_delta(diff, i);
+        if (paired[i]) {
+            continue;
+        }
+        if (delta->status == GIT_DELTA_ADDED) {
+            num_targets = num_targets + 1;
+        } else if (delta->status == GIT_DELTA_DELETED
+            || (delta->status == GIT_DELTA_MODIFIED && opts->mode == COPIES)) {
+            num_sources = num_sources + 1;
+        } else {
+            continue;
+        }
+        leftover[i] = true;
+        paths[num_paths] = (char*)(delta->status == GIT_DELTA_DELETED
+                ? delta->old_file.path
+                : delta->new_file.path);
+        num_paths = num_paths + 1;
+    }
+
+    if (num_sources == 0 || num_targets == 0
+        || num_sources * num_targets > opts->limit) {
+        memset(leftover, 0, num_deltas * sizeof(bool));
+    } else if ((error = diff_similar(out, repo, old_tree, new_tree, extension,
+                    opts, paths, num_paths, num_sources, languages, script))
+        < 0) {
+        goto cleanup;
+    }
+
+    for (i = 0; i < num_deltas; i++) {
+        if (!paired[i] && !leftover[i]
+            && (error = add_delta(out, diff, i, extension, languages, script))
+                < 0) {
+            break;
+        }
+    }
+
+cleanup:
+    if (sources != NULL) {
+        oidmap_destroy(sources);
+    }
+    if (renamed != NULL) {
+        oidmap_destroy(renamed);
+    }
+    if (deleted != NULL) {
+        oidmap_destroy(deleted);
+    }
+    return error;
+}
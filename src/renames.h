@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#ifndef RENAMES_H_ /* Include guard */
+#define RENAMES_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <git2.h>
+#include "utils.h"
+#include "oidmap.h"
+#include "arena.h"
+#include "lang.h"
+#include "survival.h"
+
+typedef int renamemode;
+#define NO_RENAMES 0
+#define RENAMES 1
+#define COPIES 2 /* renames and copies */
+
+/* default cap on the number of pairs scored for similarity */
+#define RENAME_LIMIT 1000000
+
+typedef struct {
+    renamemode mode;
+    size_t limit;
+} renameopts;
+
+int diff_with_renames(diffresult* out, git_repository* repo, arena* scratch,
+    git_diff* diff, git_tree* old_tree, git_tree* new_tree,
+    const char* extension, const renameopts* opts, diffresult* languages,
+    editscript* script);
+
+int diff_files(diffresult* out, git_diff* diff, const char* extension,
+    diffresult* languages, editscript* script);
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#include "sample.h"
+
+void sample_add(samplesum* s, double value) {
+    s->sum = s->sum + value;
+    s->squares = s->squares + value * value;
+}
+
+static int index_compare(const void* a, const void* b) {
+    size_t x = *(const size_t*)a;
+    size_t y = *(const size_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Picks size distinct indices out of [0, population) uniformly at random
+ * and returns them in ascending order, so that the sampled items can
+ * still be visited in order. out needs room for population indices.
+ */
+void sample_indices(
+    size_t* out, size_t population, size_t size, unsigned int* seed) {
+    size_t i;
+
+    for (i = 0; i < population; i++) {
+        out[i] = i;
+    }
+
+    /* partial Fisher-Yates shuffle */
+    for (i = 0; i < size && i < population; i++) {
+        size_t j = i + (size_t)rand_r(seed) % (population - i);
+        size_t tmp = out[i];
+        out[i] = out[j];
+        out[j] = tmp;
+    }
+
+    qsort(out, size, sizeof(size_t), index_compare);
+}
+
+/*
+ * Expands the sample to the population total. The margin accounts for
+ * sampling without replacement and is 0 if everything was sampled.
+ */
+estimate sample_estimate(
+    const samplesum* s, size_t population, size_t size) {
+    estimate e = { 0.0, 0.0 };
+    double n = (double)size;
+    double N = (double)population;
+    double mean;
+    double variance;
+
+    if (size == 0) {
+        return e;
+    }
+
+    mean = s->sum / n;
+    e.total = N * mean;
+
+    if (size > 1 && size < population) {
+        variance = (s->squares - n * mean * mean) / (n - 1);
+        if (variance < 0.0) {
+            variance = 0.0;
+        }
+        e.margin = SAMPLE_Z * N * sqrt(variance / n * (1.0 - n / N));
+    }
+
+    return e;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#ifndef SAMPLE_H_ /* Include guard */
+#define SAMPLE_H_
+
+#include <stdlib.h>
+#include <math.h>
+
+/* z value of a two-sided 95% confidence interval */
+#define SAMPLE_Z 1.96
+
+/* estimate of a population total and the half width of its
+ * confidence interval */
+typedef struct {
+    double total;
+    double margin;
+} estimate;
+
+/* running sums over the sampled values of one stratum */
+typedef struct {
+    double sum;
+    double squares;
+} samplesum;
+
+void sample_add(samplesum* s, double value);
+
+void sample_indices(
+    size_t* out, size_t population, size_t size, unsigned int* seed);
+
+estimate sample_estimate(
+    const samplesum* s, size_t population, size_t size);
+
+#endif
@@ -0,0 +1,365 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+#include "server.h"
+
+static int repo_compare(void const* item1, void const* item2) {
+    return strcmp((char const*)item1, ((churny_ctx const*)item2)->path);
+}
+
+/* repositories stay open, so their caches are warm for the next query */
+static churny_ctx* get_repo(List* repos, const char* path) {
+    char resolved[PATH_MAX];
+    churny_ctx* ctx;
+    Node* ptr;
+
+    if (realpath(path, resolved) == NULL) {
+        return NULL;
+    }
+
+    for (ptr = repos->first; ptr != NULL; ptr = ptr->next) {
+        if (repo_compare(resolved, ptr->value) == 0) {
+            return (churny_ctx*)ptr->value;
+        }
+    }
+
+    if (churny_open(&ctx, resolved) < 0) {
+        return NULL;
+    }
+
+    list_add(repos, ctx);
+    return ctx;
+}
+
+static int resolve(git_oid* out, churny_ctx* ctx, const char* spec) {
+    const char id[] = "resolve";
+    char commitish[strlen(spec) + strlen("^{commit}") + 1];
+    git_object* object;
+
+    strcpy(commitish, spec);
+    strcat(commitish, "^{commit}");
+    if (git_revparse_single(&object, ctx->repo, commitish) < 0) {
+        snprintf(ctx->error, sizeof(ctx->error), "%s %s - Unknown revision: %s",
+            fatal, id, spec);
+        return -1;
+    }
+
+    *out = *git_object_id(object);
+    git_object_free(object);
+    return 0;
+}
+
+static void print_rows(
+    FILE* stream, const churnrow* rows, size_t num_rows, bool sketched) {
+    output* out = output_create(stream, CSV);
+    size_t i;
+
+    out->sketched = sketched;
+    fprintf(stream, "OK\n");
+    output_header(out);
+    for (i = 0; i < num_rows; i++) {
+        output_row(out, &rows[i]);
+    }
+    output_destroy(out);
+}
+
+/* returns false if the server should shut down */
+static bool handle_request(List* repos, char* request, FILE* stream) {
+    char* tokens[MAX_TOKENS];
+    char* args[MAX_TOKENS];
+    const char* extension = "";
+    diffmode diff_mode = ADJACENT;
+    renamemode renames = NO_RENAMES;
+    bool author_sketches = false;
+    int num_tokens = 0;
+    int num_args = 0;
+    int i;
+    churny_ctx* ctx;
+
+    char* token = strtok(request, " \t\r\n");
+    while (token != NULL && num_tokens < MAX_TOKENS) {
+        tokens[num_tokens] = token;
+        num_tokens = num_tokens + 1;
+        token = strtok(NULL, " \t\r\n");
+    }
+
+    if (num_tokens == 1 && !strcmp(tokens[0], "shutdown")) {
+        fprintf(stream, "OK\n");
+        return false;
+    }
+
+    if (num_tokens < 2) {
+        fprintf(stream, "ERR %s - Invalid request\n", fatal);
+        return true;
+    }
+
+    for (i = 2; i < num_tokens; i++) {
+        if (!strcmp(tokens[i], "-l") && i + 1 < num_tokens) {
+            extension = tokens[i + 1];
+            i = i + 1;
+        } else if (!strcmp(tokens[i], "-p") && i + 1 < num_tokens) {
+            diff_mode = !strcmp(tokens[i + 1], "first")
+                ? FIRST_PARENT
+                : !strcmp(tokens[i + 1], "all") ? ALL_PARENTS : -1;
+            i = i + 1;
+        } else if (!strcmp(tokens[i], "-r") && i + 1 < num_tokens) {
+            renames = !strcmp(tokens[i + 1], "renames")
+                ? RENAMES
+                : !strcmp(tokens[i + 1], "copies") ? COPIES : -1;
+            i = i + 1;
+        } else if (!strcmp(tokens[i], "-k")) {
+            author_sketches = true;
+        } else {
+            args[num_args] = tokens[i];
+            num_args = num_args + 1;
+        }
+    }
+
+    ctx = get_repo(repos, tokens[1]);
+    if (ctx == NULL) {
+        fprintf(stream, "ERR %s - Could not open repository: %s\n", fatal,
+            tokens[1]);
+        return true;
+    }
+    ctx->error[0] = '\0';
+
+    /* diffs are cached by commit pair, so they are valid in every mode */
+    if (diff_mode < 0) {
+        fprintf(stream, "ERR %s - Unknown parent mode\n", fatal);
+        return true;
+    }
+    if (renames < 0) {
+        fprintf(stream, "ERR %s - Unknown rename mode\n", fatal);
+        return true;
+    }
+    churny_set_diff_mode(ctx, diff_mode);
+    churny_set_renames(ctx, renames, RENAME_LIMIT);
+    churny_set_author_sketches(ctx, author_sketches);
+
+    /* all results are cached by commit id, so if HEAD has moved,
+     * only the new commits have to be diffed and counted */
+    if (!strcmp(tokens[0], "churn") && num_args <= 2) {
+        git_oid from;
+        git_oid to;
+        churnrow row;
+
+        if ((num_args > 0 && resolve(&from, ctx, args[0]) < 0)
+            || (num_args > 1 && resolve(&to, ctx, args[1]) < 0)
+            || churny_churn(&row, ctx, num_args > 0 ? &from : NULL,
+                   num_args > 1 ? &to : NULL, extension)
+                < 0) {
+            fprintf(stream, "ERR %s\n", churny_error(ctx));
+        } else {
+            print_rows(
+                stream, &row, row.num_commits > 1 ? 1 : 0, author_sketches);
+        }
+    } else if (!strcmp(tokens[0], "intervals") && num_args == 1) {
+        interval interval = !strcmp(args[0], "month")
+            ? MONTH
+            : !strcmp(args[0], "year") ? YEAR : 0;
+        churnrow* rows;
+        size_t num_rows;
+
+        if (interval == 0) {
+            fprintf(stream, "ERR %s - Unknown interval: %s\n", fatal, args[0]);
+        } else if (churny_intervals(&rows, &num_rows, ctx, interval, extension)
+            < 0) {
+            fprintf(stream, "ERR %s\n", churny_error(ctx));
+        } else {
+            print_rows(stream, rows, num_rows, author_sketches);
+            churny_rows_free(rows);
+        }
+    } else if (!strcmp(tokens[0], "stats") && num_args == 0) {
+        churny_stats stats;
+        churny_get_stats(&stats, ctx);
+        fprintf(stream, "OK\n");
+        churny_print_stats(stream, &stats);
+    } else if (!strcmp(tokens[0], "loc") && num_args <= 1) {
+        git_oid commit;
+        int loc;
+
+        if (resolve(&commit, ctx, num_args > 0 ? args[0] : "HEAD") < 0
+            || churny_loc(&loc, ctx, &commit, extension) < 0) {
+            fprintf(stream, "ERR %s\n", churny_error(ctx));
+        } else {
+            fprintf(stream, "OK\n%d\n", loc);
+        }
+    } else {
+        fprintf(stream, "ERR %s - Invalid request\n", fatal);
+    }
+
+    return true;
+}
+
+static bool handle_client(List* repos, int client) {
+    char request[MAX_REQUEST + 1];
+    size_t size = 0;
+    ssize_t n;
+    bool running = true;
+
+    /* read a single request line */
+    while (size < MAX_REQUEST) {
+        n = read(client, request + size, MAX_REQUEST - size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        size = size + n;
+        if (memchr(request, '\n', size) != NULL) {
+            break;
+        }
+    }
+    request[size] = '\0';
+
+    FILE* stream = fdopen(client, "w");
+    if (stream == NULL) {
+        close(client);
+        return running;
+    }
+
+    running = handle_request(repos, request, stream);
+    fclose(stream);
+    return running;
+}
+
+int churny_serve(const char* socket_path) {
+    const char id[] = "churny_serve";
+    struct sockaddr_un addr;
+    bool running = true;
+    int fd;
+    int client;
+    Node* ptr;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        print_error("%s %s - Socket path too long: %s\n", fatal, id,
+            socket_path);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    /* clients may go away before reading their response */
+    signal(SIGPIPE, SIG_IGN);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    unlink(socket_path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0
+        || listen(fd, 16) < 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+
+#if defined(DEBUG) || defined(TRACE)
+    print_debug("%s %s - Listening on %s\n", debug, id, socket_path);
+#endif
+
+    List* repos = list_create();
+
+    while (running) {
+        client = accept(fd, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("accept");
+            break;
+        }
+        running = handle_client(repos, client);
+    }
+
+    /* cleanup */
+    close(fd);
+    unlink(socket_path);
+    for (ptr = repos->first; ptr != NULL; ptr = ptr->next) {
+        churny_free((churny_ctx*)ptr->value);
+    }
+    list_destroy(repos);
+
+    return running ? -1 : 0;
+}
+
+int churny_query(const char* socket_path, const char* request, FILE* stream) {
+    const char id[] = "churny_query";
+    struct sockaddr_un addr;
+    char buf[MAX_REQUEST];
+    bool first = true;
+    bool ok = false;
+    int fd;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        print_error("%s %s - Socket path too long: %s\n", fatal, id,
+            socket_path);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        close(fd);
+        return -1;
+    }
+
+    FILE* response = fdopen(fd, "r+");
+    if (response == NULL) {
+        close(fd);
+        return -1;
+    }
+
+    fprintf(response, "%s\n", request);
+    fflush(response);
+    shutdown(fd, SHUT_WR);
+
+    /* the first line tells whether the request succeeded */
+    while (fgets(buf, sizeof(buf), response) != NULL) {
+        if (first) {
+            first = false;
+            ok = !strcmp(buf, "OK\n");
+            if (!ok) {
+                print_error("%s", strncmp(buf, "ERR ", 4) ? buf : buf + 4);
+            }
+        } else if (ok) {
+            fputs(buf, stream);
+        }
+    }
+
+    fclose(response);
+    return ok ? 0 : -1;
+}
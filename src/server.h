@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+#ifndef SERVER_H_ /* Include guard */
+#define SERVER_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "churny.h"
+
+/*
+ * Query protocol
+ *
+ * A client connects to the socket, sends one request line and reads
+ * the response until the server closes the connection. Requests are:
+ *
+ *   churn <repository> [<options>] [<from> [<to>]]
+ *   intervals <repository> month|year [<options>]
+ *   loc <repository> [-l <extension>] [<revision>]
+ *   stats <repository>
+ *   shutdown
+ *
+ * where <options> are -l <extension>, -p first|all, -r renames|copies
+ * and -k, as on the command line.
+ *
+ * The response starts with a line "OK", followed by the results in the
+ * same format that churny prints, or consists of a line "ERR <message>".
+ */
+#define MAX_REQUEST 4096
+#define MAX_TOKENS 16
+
+int churny_serve(const char* socket_path);
+
+int churny_query(const char* socket_path, const char* request, FILE* stream);
+
+#endif
@@ -0,0 +1,469 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#include "survival.h"
+
+void editscript_init(editscript* script) {
+    memset(script, 0, sizeof(editscript));
+}
+
+static long add_path(editscript* script, const char* path) {
+    size_t length;
+    long offset;
+
+    if (path == NULL) {
+        return -1;
+    }
+
+    length = strlen(path) + 1;
+    if (script->paths_size + length > script->paths_capacity) {
+        size_t capacity
+            = script->paths_capacity == 0 ? 256 : 2 * script->paths_capacity;
+        char* paths;
+        while (capacity < script->paths_size + length) {
+            capacity = 2 * capacity;
+        }
+        if ((paths = realloc(script->paths, capacity)) == NULL) {
+            return -2;
+        }
+        script->paths = paths;
+        script->paths_capacity = capacity;
+    }
+
+    offset = (long)script->paths_size;
+    memcpy(script->paths + offset, path, length);
+    script->paths_size = script->paths_size + length;
+    return offset;
+}
+
+int editscript_add_file(
+    editscript* script, const char* old_path, const char* new_path) {
+    filechange* file;
+
+    if (script->num_files == script->files_capacity) {
+        size_t capacity
+            = script->files_capacity == 0 ? 8 : 2 * script->files_capacity;
+        filechange* files
+            = realloc(script->files, capacity * sizeof(filechange));
+        if (files == NULL) {
+            return -1;
+        }
+        script->files = files;
+        script->files_capacity = capacity;
+    }
+
+    file = &script->files[script->num_files];
+    if ((file->old_path = add_path(script, old_path)) < -1
+        || (file->new_path = add_path(script, new_path)) < -1) {
+        return -1;
+    }
+    file->first_hunk = script->num_hunks;
+    file->num_hunks = 0;
+    script->num_files = script->num_files + 1;
+    return 0;
+}
+
+/* the patch must have been created without context lines */
+int editscript_add_patch(editscript* script, git_patch* patch) {
+    filechange* file = &script->files[script->num_files - 1];
+    size_t num_hunks = git_patch_num_hunks(patch);
+    const git_diff_hunk* hunk;
+    size_t num_lines;
+    size_t i;
+
+    for (i = 0; i < num_hunks; i++) {
+        linehunk* h;
+
+        if (git_patch_get_hunk(&hunk, &num_lines, patch, i) < 0) {
+            return -1;
+        }
+
+        if (script->num_hunks == script->hunks_capacity) {
+            size_t capacity = script->hunks_capacity == 0
+                ? 16
+                : 2 * script->hunks_capacity;
+            linehunk* hunks
+                = realloc(script->hunks, capacity * sizeof(linehunk));
+            if (hunks == NULL) {
+                return -1;
+            }
+            script->hunks = hunks;
+            script->hunks_capacity = capacity;
+        }
+
+        h = &script->hunks[script->num_hunks];
+        h->old_start = hunk->old_start;
+        h->old_lines = hunk->old_lines;
+        h->new_start = hunk->new_start;
+        h->new_lines = hunk->new_lines;
+        script->num_hunks = script->num_hunks + 1;
+        file->num_hunks = file->num_hunks + 1;
+    }
+
+    return 0;
+}
+
+void editscript_free(editscript* script) {
+    free(script->files);
+    free(script->hunks);
+    free(script->paths);
+    memset(script, 0, sizeof(editscript));
+}
+
+/* appends [start, end), merging it with the last span if they touch */
+static int append_span(spanlist* list, long start, long end) {
+    linespan* last;
+
+    if (end > INT_MAX) {
+        end = INT_MAX;
+    }
+    if (start >= end) {
+        return 0;
+    }
+
+    last = list->size > 0 ? &list->spans[list->size - 1] : NULL;
+    if (last != NULL && start <= last->end) {
+        if (end > last->end) {
+            last->end = (int)end;
+        }
+        return 0;
+    }
+
+    if (list->size == list->capacity) {
+        size_t capacity = list->capacity == 0 ? 4 : 2 * list->capacity;
+        linespan* spans = realloc(list->spans, capacity * sizeof(linespan));
+        if (spans == NULL) {
+            return -1;
+        }
+        list->spans = spans;
+        list->capacity = capacity;
+    }
+
+    list->spans[list->size].start = (int)start;
+    list->spans[list->size].end = (int)end;
+    list->size = list->size + 1;
+    return 0;
+}
+
+/*
+ * Goes over the spans from *i on that overlap [start, end), returns the
+ * number of lines they cover there. If out is not NULL, the overlapping
+ * pieces are also appended to out, moved by shift. A span that reaches
+ * beyond end is left for the next range.
+ */
+static long walk_spans(spanlist* out, const spanlist* in, size_t* i,
+    long start, long end, long shift) {
+    long covered = 0;
+
+    while (*i < in->size && in->spans[*i].start < end) {
+        const linespan* span = &in->spans[*i];
+        long s = span->start > start ? span->start : start;
+        long e = span->end < end ? span->end : end;
+
+        if (s < e) {
+            covered = covered + e - s;
+            if (out != NULL && append_span(out, s + shift, e + shift) < 0) {
+                return -1;
+            }
+        }
+        if (span->end > end) {
+            break;
+        }
+        *i = *i + 1;
+    }
+
+    return covered;
+}
+
+/*
+ * Maps the dead lines of the new version of a file to the old version,
+ * over the hunks of the file, and counts the added lines that survive.
+ * With no context, a hunk that adds or deletes nothing starts after the
+ * line git names.
+ */
+static int map_back(spanlist* out, long* survived, const spanlist* dead,
+    const linehunk* hunks, size_t num_hunks) {
+    long new_pos = 1;
+    long old_pos = 1;
+    size_t i = 0;
+    size_t h;
+    long n;
+
+    for (h = 0; h < num_hunks; h++) {
+        const linehunk* hunk = &hunks[h];
+        long new_begin = hunk->new_lines == 0 ? hunk->new_start + 1
+                                              : hunk->new_start;
+        long old_begin = hunk->old_lines == 0 ? hunk->old_start + 1
+                                              : hunk->old_start;
+
+        /* unchanged lines before the hunk */
+        if (walk_spans(out, dead, &i, new_pos, new_begin, old_begin - new_begin)
+            < 0) {
+            return -1;
+        }
+
+        /* added lines */
+        if ((n = walk_spans(
+                 NULL, dead, &i, new_begin, new_begin + hunk->new_lines, 0))
+            < 0) {
+            return -1;
+        }
+        *survived = *survived + hunk->new_lines - n;
+
+        /* deleted lines do not survive */
+        if (out != NULL
+            && append_span(out, old_begin, old_begin + hunk->old_lines) < 0) {
+            return -1;
+        }
+
+        new_pos = new_begin + hunk->new_lines;
+        old_pos = old_begin + hunk->old_lines;
+    }
+
+    /* unchanged lines after the last hunk */
+    if (walk_spans(out, dead, &i, new_pos, INT_MAX, old_pos - new_pos) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* lines that are dead in both, for files copied onto each other */
+static int intersect(spanlist* out, const spanlist* a, const spanlist* b) {
+    size_t i = 0;
+    size_t j = 0;
+
+    while (i < a->size && j < b->size) {
+        int start = a->spans[i].start > b->spans[j].start ? a->spans[i].start
+                                                          : b->spans[j].start;
+        int end = a->spans[i].end < b->spans[j].end ? a->spans[i].end
+                                                    : b->spans[j].end;
+
+        if (start < end && append_span(out, start, end) < 0) {
+            return -1;
+        }
+        if (a->spans[i].end < b->spans[j].end) {
+            i = i + 1;
+        } else {
+            j = j + 1;
+        }
+    }
+
+    return 0;
+}
+
+void survival_init(survival* s) { memset(s, 0, sizeof(survival)); }
+
+static survivalfile** find_file(survival* s, const char* path) {
+    uint64_t hash = hash_string(path, strlen(path));
+    survivalfile** f;
+
+    if (s->num_buckets == 0) {
+        return NULL;
+    }
+
+    f = &s->buckets[hash & (s->num_buckets - 1)];
+    while (*f != NULL && ((*f)->hash != hash || strcmp((*f)->path, path))) {
+        f = &(*f)->next;
+    }
+    return f;
+}
+
+static void remove_file(survival* s, const char* path) {
+    survivalfile** f = find_file(s, path);
+    survivalfile* file;
+
+    if (f == NULL || *f == NULL) {
+        return;
+    }
+
+    file = *f;
+    *f = file->next;
+    free(file->dead.spans);
+    free(file->path);
+    free(file);
+    s->size = s->size - 1;
+}
+
+static int grow(survival* s) {
+    size_t num_buckets = s->num_buckets == 0 ? 256 : 2 * s->num_buckets;
+    survivalfile** buckets = calloc(num_buckets, sizeof(survivalfile*));
+    size_t i;
+
+    if (buckets == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < s->num_buckets; i++) {
+        survivalfile* f = s->buckets[i];
+        while (f != NULL) {
+            survivalfile* next = f->next;
+            size_t b = f->hash & (num_buckets - 1);
+            f->next = buckets[b];
+            buckets[b] = f;
+            f = next;
+        }
+    }
+
+    free(s->buckets);
+    s->buckets = buckets;
+    s->num_buckets = num_buckets;
+    return 0;
+}
+
+/* takes over the spans, which are intersected with those of a file
+ * that is there already */
+static int merge_file(survival* s, const char* path, spanlist* dead) {
+    survivalfile** f = find_file(s, path);
+    survivalfile* file;
+    spanlist both = { NULL, 0, 0 };
+
+    if (f != NULL && *f != NULL) {
+        if (intersect(&both, &(*f)->dead, dead) < 0) {
+            free(both.spans);
+            return -1;
+        }
+        free((*f)->dead.spans);
+        free(dead->spans);
+        (*f)->dead = both;
+        return 0;
+    }
+
+    if ((s->size + 1 > s->num_buckets && grow(s) < 0)
+        || (file = (survivalfile*)malloc(sizeof(survivalfile))) == NULL) {
+        return -1;
+    }
+    if ((file->path = strdup(path)) == NULL) {
+        free(file);
+        return -1;
+    }
+    file->hash = hash_string(path, strlen(path));
+    file->dead = *dead;
+    f = &s->buckets[file->hash & (s->num_buckets - 1)];
+    file->next = *f;
+    *f = file;
+    s->size = s->size + 1;
+    return 0;
+}
+
+/*
+ * Applies the script of a diff from an older to a newer commit, going
+ * back from the newer one. The added lines that survive are added to
+ * surviving and to their language in languages, either may be NULL.
+ */
+int survival_apply(survival* s, const editscript* script,
+    unsigned long* surviving, unsigned long* languages) {
+    spanlist* results;
+    spanlist empty = { NULL, 0, 0 };
+    size_t i;
+    int error = 0;
+
+    if (script->num_files == 0) {
+        return 0;
+    }
+
+    results = (spanlist*)calloc(script->num_files, sizeof(spanlist));
+    if (results == NULL) {
+        return -1;
+    }
+
+    /* the dead lines of the older versions, before anything is moved */
+    for (i = 0; error == 0 && i < script->num_files; i++) {
+        const filechange* file = &script->files[i];
+        const spanlist* dead = &empty;
+        survivalfile** f;
+        long survived = 0;
+        int language;
+
+        if (file->new_path < 0) {
+            error = append_span(&results[i], 1, INT_MAX);
+            continue;
+        }
+
+        f = find_file(s, script->paths + file->new_path);
+        if (f != NULL && *f != NULL) {
+            dead = &(*f)->dead;
+        }
+        error = map_back(file->old_path < 0 ? NULL : &results[i], &survived,
+            dead, script->hunks + file->first_hunk, file->num_hunks);
+
+        if (surviving != NULL) {
+            *surviving = *surviving + survived;
+        }
+        if (languages != NULL
+            && (language = language_of(script->paths + file->new_path))
+                >= 0) {
+            languages[language] = languages[language] + survived;
+        }
+    }
+
+    for (i = 0; error == 0 && i < script->num_files; i++) {
+        if (script->files[i].new_path >= 0) {
+            remove_file(s, script->paths + script->files[i].new_path);
+        }
+    }
+
+    for (i = 0; error == 0 && i < script->num_files; i++) {
+        if (script->files[i].old_path >= 0) {
+            if ((error = merge_file(s,
+                     script->paths + script->files[i].old_path, &results[i]))
+                == 0) {
+                memset(&results[i], 0, sizeof(spanlist));
+            }
+        }
+    }
+
+    /* files without dead lines need no entry */
+    for (i = 0; error == 0 && i < script->num_files; i++) {
+        survivalfile** f;
+        if (script->files[i].old_path >= 0
+            && (f = find_file(s, script->paths + script->files[i].old_path))
+                != NULL
+            && *f != NULL && (*f)->dead.size == 0) {
+            remove_file(s, script->paths + script->files[i].old_path);
+        }
+    }
+
+    for (i = 0; i < script->num_files; i++) {
+        free(results[i].spans);
+    }
+    free(results);
+    return error;
+}
+
+void survival_destroy(survival* s) {
+    size_t i;
+
+    for (i = 0; i < s->num_buckets; i++) {
+        survivalfile* f = s->buckets[i];
+        while (f != NULL) {
+            survivalfile* next = f->next;
+            free(f->dead.spans);
+            free(f->path);
+            free(f);
+            f = next;
+        }
+    }
+    free(s->buckets);
+    memset(s, 0, sizeof(survival));
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#ifndef SURVIVAL_H_ /* Include guard */
+#define SURVIVAL_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <git2.h>
+#include "utils.h"
+#include "lang.h"
+
+/*
+ * Line survival: how many of the lines added by a diff are still there
+ * at HEAD, without running blame.
+ *
+ * A diff is recorded as an edit script, the files it changed and their
+ * hunks without context. Scripts are applied from HEAD backwards in
+ * history, to a set of dead lines per file: lines that do not survive to
+ * HEAD, as sorted spans of line numbers in the version of the file that
+ * is applied next. At HEAD, nothing is dead. Going back over a diff, its
+ * added lines that are not dead survive and are credited to the diff,
+ * its deleted lines are dead in the older version, and all other lines
+ * move by the size of the hunks before them. Files a script does not
+ * touch keep their spans, so the cost of a script is in proportion to
+ * its hunks and the spans of the files it changed, not to the lines of
+ * code.
+ *
+ * The history has to be a chain, so that every version of a file is
+ * reached from HEAD in exactly one way.
+ */
+
+/* a hunk without context lines, with git's line numbers */
+typedef struct {
+    int old_start;
+    int old_lines;
+    int new_start;
+    int new_lines;
+} linehunk;
+
+/* a file changed by a diff, paths are offsets into the path buffer */
+typedef struct {
+    long old_path; /* -1 if the file was added */
+    long new_path; /* -1 if the file was deleted */
+    size_t first_hunk;
+    size_t num_hunks;
+} filechange;
+
+typedef struct {
+    filechange* files;
+    size_t num_files;
+    size_t files_capacity;
+    linehunk* hunks;
+    size_t num_hunks;
+    size_t hunks_capacity;
+    char* paths;
+    size_t paths_size;
+    size_t paths_capacity;
+} editscript;
+
+/* lines [start, end) */
+typedef struct {
+    int start;
+    int end;
+} linespan;
+
+typedef struct {
+    linespan* spans;
+    size_t size;
+    size_t capacity;
+} spanlist;
+
+typedef struct survivalfile survivalfile;
+
+struct survivalfile {
+    char* path;
+    uint64_t hash;
+    spanlist dead;
+    survivalfile* next;
+};
+
+/* files with dead lines, hashed by path */
+typedef struct {
+    survivalfile** buckets;
+    size_t num_buckets;
+    size_t size;
+} survival;
+
+void editscript_init(editscript* script);
+
+/* either path may be NULL */
+int editscript_add_file(
+    editscript* script, const char* old_path, const char* new_path);
+
+/* adds the hunks of the patch to the last file */
+int editscript_add_patch(editscript* script, git_patch* patch);
+
+void editscript_free(editscript* script);
+
+void survival_init(survival* s);
+
+int survival_apply(survival* s, const editscript* script,
+    unsigned long* surviving, unsigned long* languages);
+
+void survival_destroy(survival* s);
+
+#endif
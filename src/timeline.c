@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#include "timeline.h"
+
+typedef struct {
+    const char* name;
+    uint64_t start; /* nanoseconds since the timeline was enabled */
+    uint64_t duration;
+} event;
+
+/* only written by its thread */
+typedef struct ringbuffer {
+    int tid;
+    bool alive; /* false once the thread has exited */
+    size_t written; /* the last event is at (written - 1) % TIMELINE_EVENTS */
+    event* events;
+    struct ringbuffer* next;
+} ringbuffer;
+
+static volatile bool enabled = false;
+static uint64_t epoch;
+static pthread_key_t key;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+/* all buffers, the lock is only taken when a thread records its first
+ * span and when the timeline is written */
+static ringbuffer* buffers = NULL;
+static int num_buffers = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* the events of a thread are kept after it has exited,
+ * the workers are usually gone when the timeline is written */
+static void release(void* arg) {
+    pthread_mutex_lock(&lock);
+    ((ringbuffer*)arg)->alive = false;
+    pthread_mutex_unlock(&lock);
+}
+
+static void create_key(void) { pthread_key_create(&key, release); }
+
+static ringbuffer* local_buffer(void) {
+    ringbuffer* buffer = (ringbuffer*)pthread_getspecific(key);
+
+    if (buffer != NULL) {
+        return buffer;
+    }
+
+    buffer = (ringbuffer*)calloc(1, sizeof(ringbuffer));
+    if (buffer == NULL) {
+        return NULL;
+    }
+    buffer->events = (event*)malloc(TIMELINE_EVENTS * sizeof(event));
+    if (buffer->events == NULL) {
+        free(buffer);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&lock);
+    buffer->tid = num_buffers;
+    buffer->alive = true;
+    num_buffers = num_buffers + 1;
+    buffer->next = buffers;
+    buffers = buffer;
+    pthread_mutex_unlock(&lock);
+
+    pthread_setspecific(key, buffer);
+    return buffer;
+}
+
+/* starts recording spans, previous ones are dropped */
+void timeline_enable(void) {
+    pthread_once(&once, create_key);
+    timeline_disable();
+    epoch = now();
+    enabled = true;
+}
+
+void span_begin(span* s, const char* name) {
+    s->name = enabled ? name : NULL;
+    s->start = s->name != NULL ? now() : 0;
+}
+
+void span_end(span* s) {
+    ringbuffer* buffer;
+    event* e;
+
+    if (s->name == NULL || !enabled || (buffer = local_buffer()) == NULL) {
+        return;
+    }
+
+    e = &buffer->events[buffer->written % TIMELINE_EVENTS];
+    e->name = s->name;
+    e->start = s->start - epoch;
+    e->duration = now() - s->start;
+    buffer->written = buffer->written + 1;
+}
+
+/* must only be called when no thread is recording anymore,
+ * timestamps are in microseconds */
+int timeline_write(const char* path) {
+    ringbuffer* buffer;
+    bool first = true;
+    FILE* fp;
+    size_t i;
+    int error = 0;
+
+    if ((fp = fopen(path, "w")) == NULL) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&lock);
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (buffer = buffers; buffer != NULL; buffer = buffer->next) {
+        size_t from = buffer->written > TIMELINE_EVENTS
+            ? buffer->written - TIMELINE_EVENTS
+            : 0;
+
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                    "\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+            first ? "" : ",\n", buffer->tid, buffer->tid);
+        first = false;
+
+        for (i = from; i < buffer->written; i++) {
+            event* e = &buffer->events[i % TIMELINE_EVENTS];
+            fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                        "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                e->name, buffer->tid, e->start / 1000.0,
+                e->duration / 1000.0);
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    pthread_mutex_unlock(&lock);
+
+    if (fflush(fp) != 0) {
+        error = -1;
+    }
+    if (fclose(fp) != 0) {
+        error = -1;
+    }
+    return error;
+}
+
+/* stops recording and drops all events, must only be called when no
+ * thread is recording, threads that are still alive keep their buffers */
+void timeline_disable(void) {
+    ringbuffer** link = &buffers;
+    ringbuffer* buffer;
+
+    enabled = false;
+
+    pthread_mutex_lock(&lock);
+    while ((buffer = *link) != NULL) {
+        if (buffer->alive) {
+            buffer->written = 0;
+            link = &buffer->next;
+        } else {
+            *link = buffer->next;
+            free(buffer->events);
+            free(buffer);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
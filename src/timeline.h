@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#ifndef TIMELINE_H_ /* Include guard */
+#define TIMELINE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif
+
+/*
+ * Timeline of the hot paths of an analysis, for debugging stalls.
+ *
+ * Spans (revwalk batches, diffs, lines of code jobs, runs of blobs
+ * counted for them, emitted rows and output flushes) are recorded as
+ * begin and end times per thread. Every thread writes to a ring buffer
+ * of its own, so recording takes no lock, and only the last
+ * TIMELINE_EVENTS spans of each thread are kept. The buffers are written
+ * as Chrome trace JSON, which chrome://tracing and Perfetto can open,
+ * once all threads are done.
+ *
+ * If sys/sdt.h is available, every span also has USDT probes, e.g.,
+ * churny:diff__begin and churny:diff__end, which perf and bpftrace can
+ * attach to. They cost nothing while nobody is attached, whether the
+ * timeline is enabled or not.
+ */
+#define TIMELINE_EVENTS 65536
+
+#ifdef HAVE_SYS_SDT_H
+#define TIMELINE_PROBE(point) DTRACE_PROBE(churny, point)
+#else
+#define TIMELINE_PROBE(point)
+#endif
+
+#define TIMELINE_BEGIN(s, point)                                              \
+    do {                                                                      \
+        TIMELINE_PROBE(point##__begin);                                       \
+        span_begin(s, #point);                                                \
+    } while (0)
+
+#define TIMELINE_END(s, point)                                                \
+    do {                                                                      \
+        span_end(s);                                                          \
+        TIMELINE_PROBE(point##__end);                                         \
+    } while (0)
+
+typedef struct {
+    const char* name; /* NULL if the timeline was disabled at the begin */
+    uint64_t start;
+} span;
+
+void timeline_enable(void);
+
+void span_begin(span* s, const char* name);
+
+void span_end(span* s);
+
+int timeline_write(const char* path);
+
+void timeline_disable(void);
+
+#endif
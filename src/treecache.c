@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#include "treecache.h"
+
+void treecache_init(treecache* cache) { memset(cache, 0, sizeof(treecache)); }
+
+/* the returned tree has to be freed by the caller, cache may be NULL,
+ * so may tree_id, the tree of the commit, if it is not known from the
+ * commit graph, then the commit is parsed */
+int treecache_lookup(git_tree** out, treecache* cache, git_repository* repo,
+    const git_oid* commit, const git_oid* tree_id) {
+    git_commit* c = NULL;
+    git_tree* tree = NULL;
+    treecache_entry* victim;
+    int error;
+    int i;
+
+    if (cache != NULL) {
+        cache->clock = cache->clock + 1;
+        victim = &cache->entries[0];
+
+        for (i = 0; i < TREECACHE_SIZE; i++) {
+            treecache_entry* entry = &cache->entries[i];
+            if (entry->tree != NULL && git_oid_equal(&entry->commit, commit)) {
+                entry->stamp = cache->clock;
+                cache->hits = cache->hits + 1;
+                return git_tree_dup(out, entry->tree);
+            }
+            if (entry->stamp < victim->stamp) {
+                victim = entry;
+            }
+        }
+
+        cache->misses = cache->misses + 1;
+    }
+
+    if (tree_id != NULL) {
+        if ((error = git_tree_lookup(&tree, repo, tree_id)) < 0) {
+            return error;
+        }
+    } else if ((error = git_commit_lookup(&c, repo, commit)) < 0
+        || (error = git_commit_tree(&tree, c)) < 0) {
+        git_commit_free(c);
+        return error;
+    }
+    git_commit_free(c);
+
+    if (cache != NULL) {
+        /* replace the least recently used entry */
+        git_tree_free(victim->tree);
+        victim->tree = NULL;
+        if (git_tree_dup(&victim->tree, tree) == 0) {
+            victim->commit = *commit;
+            victim->stamp = cache->clock;
+        }
+    }
+
+    *out = tree;
+    return 0;
+}
+
+void treecache_clear(treecache* cache) {
+    int i;
+
+    for (i = 0; i < TREECACHE_SIZE; i++) {
+        git_tree_free(cache->entries[i].tree);
+        cache->entries[i].tree = NULL;
+        cache->entries[i].stamp = 0;
+    }
+}
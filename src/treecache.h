@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2014 Olaf Lessenich
+ * Copyright (C) 2014-2015 University of Passau, Germany
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ *
+ * Contributors:
+ *     Olaf Lessenich <lessenic@fim.uni-passau.de>
+ */
+
+
+#ifndef TREECACHE_H_ /* Include guard */
+#define TREECACHE_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <git2.h>
+
+#define TREECACHE_SIZE 4
+
+/*
+ * Keeps the trees of the most recently diffed commits of one worker.
+ * Adjacent commit pairs share a commit, so when a worker diffs a run of
+ * adjacent pairs, every tree is only loaded and resolved once.
+ */
+typedef struct {
+    git_oid commit;
+    git_tree* tree;
+    unsigned long stamp;
+} treecache_entry;
+
+typedef struct {
+    treecache_entry entries[TREECACHE_SIZE];
+    unsigned long clock;
+    unsigned long hits;
+    unsigned long misses;
+} treecache;
+
+void treecache_init(treecache* cache);
+
+int treecache_lookup(git_tree** out, treecache* cache, git_repository* repo,
+    const git_oid* commit, const git_oid* tree_id);
+
+void treecache_clear(treecache* cache);
+
+#endif
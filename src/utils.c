@@ -62,3 +62,17 @@ git_time_t tm_to_utc(struct tm* tm) {
     }
     return time;
 }
+
+/* FNV-1a, followed by the splitmix64 finalizer to spread the bits */
+uint64_t hash_string(const char* s, size_t length) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        h = (h ^ (unsigned char)s[i]) * 0x100000001b3ULL;
+    }
+
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
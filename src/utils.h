@@ -27,6 +27,7 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <stdint.h>
 #include <git2.h>
 
 extern const char fatal[];
@@ -43,5 +44,6 @@ void print_debug(const char* format, ...);
 void print_error(const char* format, ...);
 void exit_error(const int err, const char* format, ...);
 git_time_t tm_to_utc(struct tm* tm);
+uint64_t hash_string(const char* s, size_t length);
 
 #endif